@@ -0,0 +1,403 @@
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+
+#include "../lock-free-queue/locked_queue.h"
+#include "../lock-free-queue/mpmc_queue.h"
+#include "../lock-free-skiplist/lazy_skiplist.h"
+#include "../lock-free-skiplist/lock_free_skiplist.h"
+#include "../lock-free-stack/fc_stack.h"
+#include "../lock-free-stack/lock_free_stack.h"
+#include "../lock-free-stack/not_lockfree_stack.h"
+#include "../locks/clh-lock.h"
+#include "../locks/futex-lock.h"
+#include "../locks/mcs-lock.h"
+#include "../locks/rw-lock.h"
+#include "../locks/spin-lock.h"
+#include "../locks/ticket-lock.h"
+#include "harness.h"
+
+// Readers take the lock shared when it supports that and exclusively
+// otherwise, so every lock runs the same read/write mix.
+template <typename Mutex>
+auto lock_for_read(Mutex& mutex, int) -> decltype(mutex.lock_shared()) {
+  mutex.lock_shared();
+}
+template <typename Mutex>
+void lock_for_read(Mutex& mutex, long) {
+  mutex.lock();
+}
+template <typename Mutex>
+auto unlock_for_read(Mutex& mutex, int) -> decltype(mutex.unlock_shared()) {
+  mutex.unlock_shared();
+}
+template <typename Mutex>
+void unlock_for_read(Mutex& mutex, long) {
+  mutex.unlock();
+}
+
+// A lock guarding a counter: inserts and removes increment it under the
+// exclusive lock, reads load it under the shared one.
+template <typename Mutex>
+class lock_adapter {
+ public:
+  explicit lock_adapter(const bench_config& config)
+      : work_(config.critical_work) {}
+  void prefill(const std::vector<uint64_t>&) {}
+  bool read(uint64_t) {
+    lock_for_read(mutex_, 0);
+    spin_work(work_);
+    uint64_t value = value_;
+    unlock_for_read(mutex_, 0);
+    return value & 1;
+  }
+  bool insert(uint64_t) {
+    mutex_.lock();
+    spin_work(work_);
+    ++value_;
+    mutex_.unlock();
+    return true;
+  }
+  bool remove(uint64_t key) { return insert(key); }
+
+ private:
+  Mutex mutex_;
+  uint64_t value_ = 0;
+  unsigned work_;
+};
+
+// Pushes and pops; there is nothing to read. The reclaimers and the
+// combiner get a slot for every worker plus the thread that prefills.
+template <typename Stack>
+class stack_adapter {
+ public:
+  explicit stack_adapter(const bench_config& config)
+      : stack_(config.threads + 1) {}
+  void prefill(const std::vector<uint64_t>& keys) {
+    for (uint64_t key : keys) {
+      stack_.push(static_cast<int>(key));
+    }
+  }
+  bool read(uint64_t) { return false; }
+  bool insert(uint64_t key) {
+    stack_.push(static_cast<int>(key));
+    return true;
+  }
+  bool remove(uint64_t) {
+    int value;
+    return stack_.try_pop(value);
+  }
+
+ private:
+  Stack stack_;
+};
+
+template <typename Queue>
+class queue_adapter {
+ public:
+  static constexpr size_t capacity = 1 << 16;
+
+  explicit queue_adapter(const bench_config&) : queue_(capacity) {}
+  void prefill(const std::vector<uint64_t>& keys) {
+    for (uint64_t key : keys) {
+      queue_.try_enqueue(static_cast<int>(key));
+    }
+  }
+  bool read(uint64_t) { return false; }
+  bool insert(uint64_t key) {
+    return queue_.try_enqueue(static_cast<int>(key));
+  }
+  bool remove(uint64_t) {
+    int value;
+    return queue_.try_dequeue(value);
+  }
+
+ private:
+  Queue queue_;
+};
+
+// The reclaimer gets a slot for every worker plus the thread that prefills,
+// as for the stacks.
+template <typename Set>
+class set_adapter {
+ public:
+  explicit set_adapter(const bench_config& config)
+      : set_(reclaimer_capacity{config.threads + 1}) {}
+  void prefill(const std::vector<uint64_t>& keys) {
+    for (uint64_t key : keys) {
+      set_.add(static_cast<int>(key));
+    }
+  }
+  bool read(uint64_t key) { return set_.contains(static_cast<int>(key)); }
+  bool insert(uint64_t key) { return set_.add(static_cast<int>(key)); }
+  bool remove(uint64_t key) { return set_.remove(static_cast<int>(key)); }
+
+ private:
+  Set set_;
+};
+
+// Same as set_adapter, but every worker passes a finger of its own, so runs of
+// nearby keys (--dist=sequential) resume from where the last operation
+// ended. Workers are new threads for every run, so a thread_local finger
+// only ever belongs to the set of the current run.
+template <typename Set>
+class finger_set_adapter {
+ public:
+  explicit finger_set_adapter(const bench_config& config)
+      : set_(reclaimer_capacity{config.threads + 1}) {}
+  void prefill(const std::vector<uint64_t>& keys) {
+    for (uint64_t key : keys) {
+      set_.add(static_cast<int>(key));
+    }
+  }
+  bool read(uint64_t key) {
+    return set_.contains(finger(), static_cast<int>(key));
+  }
+  bool insert(uint64_t key) {
+    return set_.add(finger(), static_cast<int>(key));
+  }
+  bool remove(uint64_t key) {
+    return set_.remove(finger(), static_cast<int>(key));
+  }
+
+ private:
+  typename Set::Finger& finger() {
+    thread_local std::optional<typename Set::Finger> finger;
+    if (!finger) {
+      finger.emplace(set_.finger());
+    }
+    return *finger;
+  }
+
+  Set set_;
+};
+
+template <typename T>
+using ebr_lockfree_stack = lockfree_stack<T, epoch_reclaimer>;
+template <typename Backoff>
+using lockfree_skiplist = LockFreeSkiplist<int, 32, std::less<int>, Backoff>;
+template <typename Backoff>
+using lazy_skiplist = LazySkiplist<int, 32, std::less<int>, Backoff>;
+
+struct structure_entry {
+  const char* name;
+  // Default read:insert:remove mix.
+  const char* mix;
+  // Stacks and queues have no lookup and reject a mix with reads.
+  bool reads;
+  bench_result (*run)(const bench_config&);
+};
+
+// Every structure the harness can run. Builds with -DNO_PADDING or
+// -DNO_ELIMINATION change the entries below in place.
+const structure_entry registry[] = {
+    {"std_mutex", "0:100:0", true, run_bench<lock_adapter<std::mutex>>},
+    {"shared_mutex", "0:100:0", true,
+     run_bench<lock_adapter<std::shared_mutex>>},
+    {"spin_lock", "0:100:0", true, run_bench<lock_adapter<spin_lock_TTAS>>},
+    {"ticket_lock", "0:100:0", true, run_bench<lock_adapter<ticket_lock>>},
+    {"proportional_ticket_lock", "0:100:0", true,
+     run_bench<lock_adapter<proportional_ticket_lock>>},
+    {"mcs_lock", "0:100:0", true, run_bench<lock_adapter<mcs_lock>>},
+    {"clh_lock", "0:100:0", true, run_bench<lock_adapter<clh_lock>>},
+    {"futex_lock", "0:100:0", true, run_bench<lock_adapter<futex_lock>>},
+    {"rw_spin_lock", "0:100:0", true,
+     run_bench<lock_adapter<rw_spin_lock<true>>>},
+    {"rw_spin_lock_prefer_readers", "0:100:0", true,
+     run_bench<lock_adapter<rw_spin_lock<false>>>},
+    {"distributed_rw_lock", "0:100:0", true,
+     run_bench<lock_adapter<distributed_rw_lock<true>>>},
+    {"distributed_rw_lock_prefer_readers", "0:100:0", true,
+     run_bench<lock_adapter<distributed_rw_lock<false>>>},
+    {"locked_stack", "0:50:50", false,
+     run_bench<stack_adapter<not_lockfree_stack<int>>>},
+    {"fc_stack", "0:50:50", false, run_bench<stack_adapter<fc_stack<int>>>},
+    {"lockfree_stack", "0:50:50", false,
+     run_bench<stack_adapter<lockfree_stack<int>>>},
+    {"lockfree_stack_ebr", "0:50:50", false,
+     run_bench<stack_adapter<ebr_lockfree_stack<int>>>},
+    {"locked_queue", "0:50:50", false,
+     run_bench<queue_adapter<locked_queue<int>>>},
+    {"mpmc_queue", "0:50:50", false, run_bench<queue_adapter<mpmc_queue<int>>>},
+    {"lockfree_skiplist", "34:33:33", true,
+     run_bench<set_adapter<lockfree_skiplist<exp_yield_backoff<>>>>},
+    {"lockfree_skiplist_spin", "34:33:33", true,
+     run_bench<set_adapter<lockfree_skiplist<spin_pause_backoff<>>>>},
+    {"lockfree_skiplist_no_backoff", "34:33:33", true,
+     run_bench<set_adapter<lockfree_skiplist<no_backoff>>>},
+    {"lockfree_skiplist_finger", "50:50:0", true,
+     run_bench<finger_set_adapter<lockfree_skiplist<exp_yield_backoff<>>>>},
+    {"lazy_skiplist", "34:33:33", true,
+     run_bench<set_adapter<lazy_skiplist<exp_yield_backoff<>>>>},
+    {"lazy_skiplist_spin", "34:33:33", true,
+     run_bench<set_adapter<lazy_skiplist<spin_pause_backoff<>>>>},
+    {"lazy_skiplist_no_backoff", "34:33:33", true,
+     run_bench<set_adapter<lazy_skiplist<no_backoff>>>},
+};
+
+void usage(const char* argv0) {
+  std::cerr
+      << "Usage: " << argv0 << " <structure> [options]\n"
+      << "       " << argv0 << " --list\n"
+      << "Options:\n"
+      << "  --threads=N          worker threads (1)\n"
+      << "  --warmup=SECONDS     uncounted warmup (1)\n"
+      << "  --duration=SECONDS   measured time (5)\n"
+      << "  --mix=R:I:D          percent of reads, inserts, removes\n"
+      << "  --keys=N             key range (65536)\n"
+      << "  --prefill=N          keys inserted up front (keys / 2)\n"
+      << "  --dist=uniform|zipfian[:THETA]|sequential  key distribution "
+         "(uniform)\n"
+      << "  --stream=N           pre-generated ops per thread (65536)\n"
+      << "  --critical=N         pause loops inside a lock (0)\n"
+      << "  --think=N            pause loops between operations (0)\n"
+      << "  --no-pin             do not pin threads to CPUs\n"
+      << "  --no-latency         do not time single operations\n"
+      << "  --seed=N             seed of the op streams (1)\n"
+      << "  --format=text|csv|json  output format (text)\n"
+      << "  --no-header          omit the CSV header line\n";
+}
+
+// Strict parsing: the whole value must be a number.
+bool parse_number(const std::string& text, uint64_t& out) {
+  if (text.empty() || text[0] == '-') {
+    return false;
+  }
+  char* end;
+  out = strtoull(text.c_str(), &end, 10);
+  return *end == '\0';
+}
+bool parse_number(const std::string& text, double& out) {
+  char* end;
+  out = strtod(text.c_str(), &end);
+  return !text.empty() && *end == '\0' && out >= 0;
+}
+
+bool parse_option(const std::string& arg, bench_config& config,
+                  bool& mix_set) {
+  size_t eq = arg.find('=');
+  std::string name = arg.substr(0, eq);
+  std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+  uint64_t number;
+  if (name == "--threads") {
+    return parse_number(value, number) && number > 0 &&
+           (config.threads = number, true);
+  } else if (name == "--warmup") {
+    return parse_number(value, config.warmup_seconds);
+  } else if (name == "--duration") {
+    return parse_number(value, config.duration_seconds) &&
+           config.duration_seconds > 0;
+  } else if (name == "--mix") {
+    return mix_set = config.mix.parse(value);
+  } else if (name == "--keys") {
+    return parse_number(value, number) && number > 0 &&
+           number <= (1ull << 31) && (config.key_range = number, true);
+  } else if (name == "--prefill") {
+    return parse_number(value, number) &&
+           (config.prefill = static_cast<int64_t>(number), true);
+  } else if (name == "--dist") {
+    if (value == "uniform") {
+      config.distribution = key_distribution::uniform;
+      return true;
+    }
+    if (value == "sequential") {
+      config.distribution = key_distribution::sequential;
+      return true;
+    }
+    if (value.compare(0, 7, "zipfian") != 0) {
+      return false;
+    }
+    config.distribution = key_distribution::zipfian;
+    if (value.size() == 7) {
+      return true;
+    }
+    return value[7] == ':' &&
+           parse_number(value.substr(8), config.zipf_theta) &&
+           config.zipf_theta > 0 && config.zipf_theta < 1;
+  } else if (name == "--stream") {
+    if (!parse_number(value, number) || number == 0 || number > (1ull << 30)) {
+      return false;
+    }
+    config.stream_length = 1;
+    while (config.stream_length < number) {
+      config.stream_length *= 2;
+    }
+    return true;
+  } else if (name == "--critical") {
+    return parse_number(value, number) &&
+           (config.critical_work = static_cast<unsigned>(number), true);
+  } else if (name == "--think") {
+    return parse_number(value, number) &&
+           (config.think_work = static_cast<unsigned>(number), true);
+  } else if (name == "--no-pin" && value.empty()) {
+    config.pin = false;
+    return true;
+  } else if (name == "--no-latency" && value.empty()) {
+    config.latency = false;
+    return true;
+  } else if (name == "--seed") {
+    return parse_number(value, config.seed);
+  } else if (name == "--format") {
+    if (value == "text") {
+      config.format = output_format::text;
+    } else if (value == "csv") {
+      config.format = output_format::csv;
+    } else if (value == "json") {
+      config.format = output_format::json;
+    } else {
+      return false;
+    }
+    return true;
+  } else if (name == "--no-header" && value.empty()) {
+    config.header = false;
+    return true;
+  }
+  return false;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc == 2 && strcmp(argv[1], "--list") == 0) {
+    for (const auto& entry : registry) {
+      std::cout << entry.name << " (" << entry.mix << ")\n";
+    }
+    return 0;
+  }
+  if (argc < 2 || argv[1][0] == '-') {
+    usage(argv[0]);
+    return 1;
+  }
+  bench_config config;
+  config.structure = argv[1];
+  const structure_entry* entry = nullptr;
+  for (const auto& candidate : registry) {
+    if (config.structure == candidate.name) {
+      entry = &candidate;
+    }
+  }
+  if (!entry) {
+    std::cerr << "Unknown structure " << config.structure
+              << ", see --list\n";
+    return 1;
+  }
+  bool mix_set = false;
+  for (int i = 2; i < argc; ++i) {
+    if (!parse_option(argv[i], config, mix_set)) {
+      std::cerr << "Bad option " << argv[i] << "\n";
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!mix_set) {
+    config.mix.parse(entry->mix);
+  } else if (!entry->reads && config.mix.percent[0] != 0) {
+    std::cerr << config.structure << " has no read operation\n";
+    return 1;
+  }
+  print_result(config, entry->run(config));
+  return 0;
+}
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Run from the repository root; prints one CSV table for every build.
+
+SOURCES="bench/bench.cpp locks/spin-lock.cpp locks/ticket-lock.cpp
+locks/mcs-lock.cpp locks/clh-lock.cpp locks/futex-lock.cpp locks/rw-lock.cpp"
+THREADS="1 2 4 8 16 32 64"
+
+run() {
+    header=
+    for s in $STRUCTURES
+    do
+        for i in $THREADS
+        do
+            ./a.out $s --threads=$i --format=csv $header "$@"
+            header=--no-header
+        done
+    done
+}
+
+# The allocator behind the stack and the skiplists must survive threads
+# exiting and handing their heaps over before anything is measured.
+g++ -O2 -std=c++17 -pthread common/slab_allocator_test.cpp && ./a.out || exit 1
+
+g++ -O2 -std=c++17 -pthread $SOURCES
+STRUCTURES=$(./a.out --list | cut -d' ' -f1)
+run
+
+echo "Sequential inserts and lookups, with and without fingers"
+STRUCTURES="lockfree_skiplist lockfree_skiplist_finger"
+run --dist=sequential --mix=50:50:0
+
+echo "Lock-free stack without elimination"
+g++ -O2 -std=c++17 -pthread $SOURCES -DNO_ELIMINATION
+STRUCTURES="lockfree_stack lockfree_stack_ebr"
+run
+
+echo "Without cache line padding"
+g++ -O2 -std=c++17 -pthread $SOURCES -DNO_PADDING
+STRUCTURES="lockfree_stack fc_stack mpmc_queue"
+run
+
+echo "Contention counters"
+g++ -O2 -std=c++17 -pthread $SOURCES -DLOCKFREE_STATS
+STRUCTURES="lockfree_stack lockfree_stack_ebr lockfree_skiplist lockfree_skiplist_spin lockfree_skiplist_no_backoff"
+run
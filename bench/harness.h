@@ -0,0 +1,517 @@
+#ifndef MY_BENCH_HARNESS
+#define MY_BENCH_HARNESS
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "../common/backoff.h"
+#include "../common/cache_line.h"
+#include "../common/stats.h"
+#include "latency_histogram.h"
+
+// Benchmark harness shared by every structure in the repo.
+//
+// A run goes through three phases: all threads are started, pinned and lined
+// up on a barrier; then they run a warmup that is not counted; then they run
+// for a fixed time, and only operations completed in that window count.
+// Operations come from per-thread streams generated before the threads start,
+// so the measured loop does nothing but fetch the next operation, apply it
+// and bump thread-local counters: no random numbers, no I/O and no shared
+// writes other than the structure's own. Each operation is timed with
+// tsc_clock into a per-thread latency_histogram per operation type; the
+// histograms are merged once the threads are joined. --no-latency drops the
+// two clock reads for a pure throughput run. A build with -DLOCKFREE_STATS
+// also reports the contention counters of common/stats.h for the measured
+// window.
+//
+// A structure is plugged in through an adapter:
+//
+//   struct adapter {
+//     explicit adapter(const bench_config& config);
+//     void prefill(const std::vector<uint64_t>& keys);  // single-threaded
+//     bool read(uint64_t key);
+//     bool insert(uint64_t key);
+//     bool remove(uint64_t key);
+//   };
+//
+// where each operation returns whether it hit: found the key, added it,
+// removed something. run_bench<adapter>() is instantiated per structure, so
+// there is no virtual call on the hot path.
+
+enum class op_type : uint8_t { read, insert, remove };
+constexpr size_t op_types_num = 3;
+
+inline const char* op_name(size_t type) {
+  static const char* const names[op_types_num] = {"read", "insert", "remove"};
+  return names[type];
+}
+
+struct op {
+  op_type type;
+  uint64_t key;
+};
+
+// Percentages of reads, inserts and removes, summing to 100.
+struct op_mix {
+  unsigned percent[op_types_num] = {0, 50, 50};
+
+  bool parse(const std::string& text) {
+    unsigned r, i, d;
+    char tail;
+    if (sscanf(text.c_str(), "%u:%u:%u%c", &r, &i, &d, &tail) != 3 ||
+        r + i + d != 100) {
+      return false;
+    }
+    percent[0] = r;
+    percent[1] = i;
+    percent[2] = d;
+    return true;
+  }
+  std::string str() const {
+    return std::to_string(percent[0]) + ":" + std::to_string(percent[1]) +
+           ":" + std::to_string(percent[2]);
+  }
+};
+
+// Sequential: every thread walks up the key range from a starting point of
+// its own, one key per operation.
+enum class key_distribution { uniform, zipfian, sequential };
+enum class output_format { text, csv, json };
+
+struct bench_config {
+  std::string structure;
+  size_t threads = 1;
+  double warmup_seconds = 1;
+  double duration_seconds = 5;
+  op_mix mix;
+  key_distribution distribution = key_distribution::uniform;
+  double zipf_theta = 0.99;
+  uint64_t key_range = 1 << 16;
+  // Keys inserted before the run; key_range / 2 unless set.
+  int64_t prefill = -1;
+  // Operations pre-generated per thread and replayed in a loop; rounded up to
+  // a power of two.
+  size_t stream_length = 1 << 16;
+  // Pause instructions spent inside a lock's critical section and between
+  // two operations.
+  unsigned critical_work = 0;
+  unsigned think_work = 0;
+  bool pin = true;
+  bool latency = true;
+  uint64_t seed = 1;
+  output_format format = output_format::text;
+  bool header = true;
+
+  uint64_t prefill_count() const {
+    return prefill < 0 ? key_range / 2
+                       : std::min<uint64_t>(prefill, key_range);
+  }
+};
+
+// Zipfian ranks in [0, n) after Gray et al., "Quickly generating
+// billion-record synthetic databases", as used by YCSB. Setup is O(n), every
+// draw O(1). Rank 0 is the most popular; callers scatter the ranks over the
+// key space so that hot keys are not all neighbours.
+class zipf_generator {
+ public:
+  zipf_generator(uint64_t n, double theta)
+      : n_(n),
+        theta_(theta),
+        alpha_(1 / (1 - theta)),
+        zetan_(zeta(n, theta)),
+        eta_((1 - std::pow(2.0 / n, 1 - theta)) /
+             (1 - zeta(2, theta) / zetan_)) {}
+
+  template <typename Rng>
+  uint64_t operator()(Rng& rng) const {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    double uz = u * zetan_;
+    if (uz < 1) {
+      return 0;
+    }
+    if (uz < 1 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    return std::min<uint64_t>(
+        n_ - 1, n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+  }
+
+ private:
+  static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; ++i) {
+      sum += 1 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  uint64_t n_;
+  double theta_;
+  double alpha_;
+  double zetan_;
+  double eta_;
+};
+
+// A bijection of [0, n): multiplication by a number coprime with n.
+class key_scatter {
+ public:
+  explicit key_scatter(uint64_t n) : n_(n), factor_(0x9e3779b97f4a7c15 % n) {
+    while (std::gcd(factor_, n_) != 1) {
+      ++factor_;
+    }
+  }
+  uint64_t operator()(uint64_t rank) const {
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(rank) *
+                                 factor_ % n_);
+  }
+
+ private:
+  uint64_t n_;
+  uint64_t factor_;
+};
+
+inline std::vector<op> make_stream(const bench_config& config,
+                                   const zipf_generator* zipf,
+                                   size_t thread_index) {
+  std::mt19937_64 rng(config.seed * 0x9e3779b97f4a7c15 + thread_index);
+  std::uniform_int_distribution<uint64_t> uniform(0, config.key_range - 1);
+  std::uniform_int_distribution<unsigned> percent(0, 99);
+  key_scatter scatter(config.key_range);
+  uint64_t next_key = thread_index * config.key_range / config.threads;
+  std::vector<op> stream(config.stream_length);
+  for (op& o : stream) {
+    unsigned p = percent(rng);
+    if (p < config.mix.percent[0]) {
+      o.type = op_type::read;
+    } else if (p < config.mix.percent[0] + config.mix.percent[1]) {
+      o.type = op_type::insert;
+    } else {
+      o.type = op_type::remove;
+    }
+    if (config.distribution == key_distribution::sequential) {
+      o.key = next_key++ % config.key_range;
+    } else {
+      o.key = zipf ? scatter((*zipf)(rng)) : uniform(rng);
+    }
+  }
+  return stream;
+}
+
+// Distinct keys spread over the whole key range.
+inline std::vector<uint64_t> make_prefill(const bench_config& config) {
+  std::vector<uint64_t> keys(config.key_range);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 rng(config.seed);
+  std::shuffle(keys.begin(), keys.end(), rng);
+  keys.resize(config.prefill_count());
+  return keys;
+}
+
+inline void pin_to_cpu(size_t index) {
+  unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(index % cpus, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+inline void spin_work(unsigned iterations) {
+  for (unsigned i = 0; i < iterations; ++i) {
+    cpu_relax();
+  }
+}
+
+struct bench_result {
+  double seconds = 0;
+  uint64_t ops[op_types_num] = {};
+  uint64_t hits[op_types_num] = {};
+  // In tsc_clock ticks; empty if latency was not recorded.
+  latency_histogram latency[op_types_num];
+  double ticks_per_ns = 1;
+  lockfree_stats::snapshot stats = {};
+
+  uint64_t total_ops() const { return ops[0] + ops[1] + ops[2]; }
+};
+
+template <typename Adapter>
+bench_result run_bench(const bench_config& config) {
+  enum phase { setup, warmup, measure, done };
+  struct thread_result {
+    uint64_t ops[op_types_num] = {};
+    uint64_t hits[op_types_num] = {};
+    latency_histogram latency[op_types_num];
+  };
+
+  Adapter adapter(config);
+  adapter.prefill(make_prefill(config));
+  std::unique_ptr<zipf_generator> zipf;
+  if (config.distribution == key_distribution::zipfian) {
+    zipf.reset(new zipf_generator(config.key_range, config.zipf_theta));
+  }
+  std::vector<std::vector<op>> streams;
+  streams.reserve(config.threads);
+  for (size_t i = 0; i < config.threads; ++i) {
+    streams.push_back(make_stream(config, zipf.get(), i));
+  }
+
+  // Calibrates the clock now rather than in the middle of the run.
+  const double ticks_per_ns = config.latency ? tsc_clock::ticks_per_ns() : 1;
+
+  padded_atomic<int> current_phase(setup);
+  padded_atomic<size_t> ready(0);
+  std::vector<padded<thread_result>> results(config.threads);
+  std::vector<std::thread> threads;
+  threads.reserve(config.threads);
+  for (size_t i = 0; i < config.threads; ++i) {
+    threads.emplace_back([&, i] {
+      if (config.pin) {
+        pin_to_cpu(i);
+      }
+      const std::vector<op>& stream = streams[i];
+      const size_t mask = stream.size() - 1;
+      uint64_t ops[op_types_num] = {};
+      uint64_t hits[op_types_num] = {};
+      // Written in place: a thread's histograms are its own.
+      latency_histogram* latency = results[i].value.latency;
+      ready.fetch_add(1);
+      while (current_phase.load(std::memory_order_acquire) == setup) {
+        std::this_thread::yield();
+      }
+      size_t next = 0;
+      auto apply = [&](const op& o) {
+        switch (o.type) {
+          case op_type::read:
+            return adapter.read(o.key);
+          case op_type::insert:
+            return adapter.insert(o.key);
+          default:
+            return adapter.remove(o.key);
+        }
+      };
+      while (current_phase.load(std::memory_order_relaxed) == warmup) {
+        apply(stream[next++ & mask]);
+        spin_work(config.think_work);
+      }
+      auto measured_loop = [&](auto timed) {
+        while (current_phase.load(std::memory_order_relaxed) == measure) {
+          const op& o = stream[next++ & mask];
+          const size_t type = static_cast<size_t>(o.type);
+          bool hit;
+          if constexpr (timed) {
+            uint64_t start = tsc_clock::now();
+            hit = apply(o);
+            latency[type].record(tsc_clock::now() - start);
+          } else {
+            hit = apply(o);
+          }
+          ++ops[type];
+          hits[type] += hit;
+          spin_work(config.think_work);
+        }
+      };
+      if (config.latency) {
+        measured_loop(std::true_type());
+      } else {
+        measured_loop(std::false_type());
+      }
+      std::copy(ops, ops + op_types_num, results[i].value.ops);
+      std::copy(hits, hits + op_types_num, results[i].value.hits);
+    });
+  }
+  while (ready.load() != config.threads) {
+    std::this_thread::yield();
+  }
+  current_phase.store(warmup, std::memory_order_release);
+  std::this_thread::sleep_for(
+      std::chrono::duration<double>(config.warmup_seconds));
+  const lockfree_stats::snapshot stats_before = lockfree_stats::collect();
+  auto start = std::chrono::steady_clock::now();
+  current_phase.store(measure, std::memory_order_relaxed);
+  std::this_thread::sleep_for(
+      std::chrono::duration<double>(config.duration_seconds));
+  current_phase.store(done, std::memory_order_relaxed);
+  auto finish = std::chrono::steady_clock::now();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  bench_result result;
+  result.seconds = std::chrono::duration<double>(finish - start).count();
+  for (const auto& r : results) {
+    for (size_t t = 0; t < op_types_num; ++t) {
+      result.ops[t] += r.value.ops[t];
+      result.hits[t] += r.value.hits[t];
+      result.latency[t].merge(r.value.latency[t]);
+    }
+  }
+  result.ticks_per_ns = ticks_per_ns;
+  result.stats = lockfree_stats::since(stats_before);
+  return result;
+}
+
+inline const char* distribution_name(key_distribution distribution) {
+  switch (distribution) {
+    case key_distribution::uniform:
+      return "uniform";
+    case key_distribution::zipfian:
+      return "zipfian";
+    default:
+      return "sequential";
+  }
+}
+
+// Reported latency percentiles.
+constexpr size_t percentiles_num = 5;
+constexpr double percentiles[percentiles_num] = {0.5, 0.9, 0.99, 0.999,
+                                                 0.9999};
+constexpr const char* percentile_names[percentiles_num] = {
+    "p50", "p90", "p99", "p99.9", "p99.99"};
+
+inline double percentile_ns(const bench_result& result, size_t type,
+                            size_t percentile) {
+  return result.latency[type].percentile(percentiles[percentile]) /
+         result.ticks_per_ns;
+}
+
+inline void print_result(const bench_config& config,
+                         const bench_result& result) {
+  const uint64_t total = result.total_ops();
+  const double throughput = total / result.seconds;
+  switch (config.format) {
+    case output_format::text:
+      printf("%s threads=%zu mix=%s keys=%s/%llu: %.0f ops/s\n",
+             config.structure.c_str(), config.threads, config.mix.str().c_str(),
+             distribution_name(config.distribution),
+             static_cast<unsigned long long>(config.key_range), throughput);
+      for (size_t t = 0; t < op_types_num; ++t) {
+        if (result.ops[t] == 0) {
+          continue;
+        }
+        printf("  %-6s %llu ops, %llu hits", op_name(t),
+               static_cast<unsigned long long>(result.ops[t]),
+               static_cast<unsigned long long>(result.hits[t]));
+        if (config.latency) {
+          printf(", ns:");
+          for (size_t p = 0; p < percentiles_num; ++p) {
+            printf(" %s=%.0f", percentile_names[p],
+                   percentile_ns(result, t, p));
+          }
+          printf(" max=%.0f",
+                 result.latency[t].max() / result.ticks_per_ns);
+        }
+        printf("\n");
+      }
+      if (lockfree_stats::enabled) {
+        printf("  stats:");
+        for (size_t i = 0; i < stat_counters_num; ++i) {
+          printf(" %s=%llu", stat_name(i),
+                 static_cast<unsigned long long>(result.stats[i]));
+        }
+        printf("\n");
+      }
+      break;
+    case output_format::csv:
+      // Latencies are in nanoseconds and left empty with --no-latency or
+      // for an operation that never ran.
+      if (config.header) {
+        printf(
+            "structure,threads,mix,distribution,key_range,prefill,seconds,"
+            "ops,ops_per_sec,read_ops,insert_ops,remove_ops,read_hits,"
+            "insert_hits,remove_hits");
+        for (size_t t = 0; t < op_types_num; ++t) {
+          for (size_t p = 0; p < percentiles_num; ++p) {
+            printf(",%s_%s", op_name(t), percentile_names[p]);
+          }
+          printf(",%s_max", op_name(t));
+        }
+        for (size_t i = 0; lockfree_stats::enabled && i < stat_counters_num;
+             ++i) {
+          printf(",%s", stat_name(i));
+        }
+        printf("\n");
+      }
+      printf("%s,%zu,%s,%s,%llu,%llu,%.3f,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,"
+             "%llu",
+             config.structure.c_str(), config.threads, config.mix.str().c_str(),
+             distribution_name(config.distribution),
+             static_cast<unsigned long long>(config.key_range),
+             static_cast<unsigned long long>(config.prefill_count()),
+             result.seconds, static_cast<unsigned long long>(total), throughput,
+             static_cast<unsigned long long>(result.ops[0]),
+             static_cast<unsigned long long>(result.ops[1]),
+             static_cast<unsigned long long>(result.ops[2]),
+             static_cast<unsigned long long>(result.hits[0]),
+             static_cast<unsigned long long>(result.hits[1]),
+             static_cast<unsigned long long>(result.hits[2]));
+      for (size_t t = 0; t < op_types_num; ++t) {
+        if (result.latency[t].total() == 0) {
+          printf(",,,,,,");
+          continue;
+        }
+        for (size_t p = 0; p < percentiles_num; ++p) {
+          printf(",%.0f", percentile_ns(result, t, p));
+        }
+        printf(",%.0f", result.latency[t].max() / result.ticks_per_ns);
+      }
+      for (size_t i = 0; lockfree_stats::enabled && i < stat_counters_num;
+           ++i) {
+        printf(",%llu", static_cast<unsigned long long>(result.stats[i]));
+      }
+      printf("\n");
+      break;
+    case output_format::json:
+      // One object per line, so that runs can be appended to one file.
+      printf("{\"structure\": \"%s\", \"threads\": %zu, \"mix\": \"%s\", "
+             "\"distribution\": \"%s\", \"key_range\": %llu, \"prefill\": "
+             "%llu, \"seconds\": %.3f, \"ops\": %llu, \"ops_per_sec\": %.0f, "
+             "\"per_op\": {",
+             config.structure.c_str(), config.threads, config.mix.str().c_str(),
+             distribution_name(config.distribution),
+             static_cast<unsigned long long>(config.key_range),
+             static_cast<unsigned long long>(config.prefill_count()),
+             result.seconds, static_cast<unsigned long long>(total),
+             throughput);
+      for (size_t t = 0; t < op_types_num; ++t) {
+        printf("%s\"%s\": {\"ops\": %llu, \"hits\": %llu", t ? ", " : "",
+               op_name(t), static_cast<unsigned long long>(result.ops[t]),
+               static_cast<unsigned long long>(result.hits[t]));
+        if (result.latency[t].total() != 0) {
+          printf(", \"latency_ns\": {");
+          for (size_t p = 0; p < percentiles_num; ++p) {
+            printf("\"%s\": %.0f, ", percentile_names[p],
+                   percentile_ns(result, t, p));
+          }
+          printf("\"max\": %.0f}",
+                 result.latency[t].max() / result.ticks_per_ns);
+        }
+        printf("}");
+      }
+      printf("}");
+      if (lockfree_stats::enabled) {
+        printf(", \"stats\": {");
+        for (size_t i = 0; i < stat_counters_num; ++i) {
+          printf("%s\"%s\": %llu", i ? ", " : "", stat_name(i),
+                 static_cast<unsigned long long>(result.stats[i]));
+        }
+        printf("}");
+      }
+      printf("}\n");
+      break;
+  }
+}
+
+#endif  // MY_BENCH_HARNESS
@@ -0,0 +1,131 @@
+#ifndef MY_LATENCY_HISTOGRAM
+#define MY_LATENCY_HISTOGRAM
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheap timestamps for timing single operations: the time stamp counter on
+// x86 and the virtual counter on ARM, steady_clock elsewhere. Reading it is a
+// couple of dozen cycles and no system call. rdtsc does not wait for earlier
+// instructions, so a timed operation may overlap its neighbours by a few
+// cycles, well below the resolution of latency_histogram.
+//
+// Assumes an invariant counter, i.e. one that ticks at a constant rate on
+// every core, which all x86 CPUs of the last decade and ARMv8 have.
+class tsc_clock {
+ public:
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  // Measured against steady_clock on the first call, which sleeps for a few
+  // milliseconds; call it before the timed part starts.
+  static double ticks_per_ns() {
+    static const double ratio = calibrate();
+    return ratio;
+  }
+
+ private:
+  static double calibrate() {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t finish_ticks = now();
+    auto finish = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = finish - start;
+    return (finish_ticks - start_ticks) / elapsed.count();
+  }
+};
+
+// Log-linear histogram in the style of HdrHistogram: every power of two is
+// split into 2^sub_bucket_bits equal buckets, so a value is kept to within
+// 1 / 2^sub_bucket_bits of itself over the whole 64-bit range. Recording is
+// a count-leading-zeros, a shift and an increment into a fixed array: no
+// allocation and nothing shared, so every thread keeps its own histograms and
+// they are merged after the run.
+class latency_histogram {
+ public:
+  static constexpr unsigned sub_bucket_bits = 6;
+  static constexpr size_t sub_buckets = size_t(1) << sub_bucket_bits;
+  static constexpr size_t buckets_num = (65 - sub_bucket_bits) * sub_buckets;
+
+  void record(uint64_t value) {
+    ++counts_[index_of(value)];
+    ++total_;
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const latency_histogram& other) {
+    for (size_t i = 0; i < buckets_num; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t total() const { return total_; }
+  uint64_t max() const { return max_; }
+
+  // Smallest recorded value v such that a fraction q of all values is <= v,
+  // up to the bucket width; q = 0.99 is the 99th percentile.
+  uint64_t percentile(double q) const {
+    if (total_ == 0) {
+      return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(q * total_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_num; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(highest_in(i), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  // Values below sub_buckets map to themselves. A larger value with its top
+  // bit at position m lands in group m - sub_bucket_bits + 1, at the bucket
+  // given by the sub_bucket_bits bits right below the top one.
+  static size_t index_of(uint64_t value) {
+    if (value < sub_buckets) {
+      return value;
+    }
+    unsigned top = 63 - __builtin_clzll(value);
+    unsigned shift = top - sub_bucket_bits;
+    return ((shift + 1) << sub_bucket_bits) +
+           ((value >> shift) - sub_buckets);
+  }
+  static uint64_t highest_in(size_t index) {
+    if (index < sub_buckets) {
+      return index;
+    }
+    unsigned shift = (index >> sub_bucket_bits) - 1;
+    uint64_t lowest = (sub_buckets + (index & (sub_buckets - 1))) << shift;
+    return lowest + ((uint64_t(1) << shift) - 1);
+  }
+
+  uint64_t counts_[buckets_num] = {};
+  uint64_t total_ = 0;
+  uint64_t max_ = 0;
+};
+
+#endif  // MY_LATENCY_HISTOGRAM
@@ -0,0 +1,77 @@
+#ifndef MY_BACKOFF
+#define MY_BACKOFF
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+#include "stats.h"
+
+// Backoff policies for the retry loops of the lock-free structures. A policy
+// object is created at the start of an operation and called once after every
+// failed attempt, so it can escalate while the operation keeps losing:
+//
+//   BackoffPolicy backoff;
+//   while (!try_once()) {
+//     backoff();
+//   }
+//
+// A structure takes the policy as a template parameter, so the choice is made
+// at compile time and the no-op policy costs nothing.
+
+// Tells the CPU that this is a spin-wait loop: cheaper for the sibling
+// hyperthread and no memory-order misspeculation on exit.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Retries right away. Best when contention is rare or the machine is
+// oversubscribed anyway.
+struct no_backoff {
+  void operator()() { lockfree_stats::add(stat_counter::backoffs); }
+};
+
+// Spins on the pause instruction, doubling the spin after every failure up to
+// `max_spins`. Never gives up the CPU.
+template <size_t min_spins = 4, size_t max_spins = 1024>
+class spin_pause_backoff {
+ public:
+  void operator()() {
+    lockfree_stats::add(stat_counter::backoffs);
+    for (size_t i = 0; i < spins_; ++i) {
+      cpu_relax();
+    }
+    spins_ = std::min(spins_ * 2, max_spins);
+  }
+
+ private:
+  size_t spins_ = min_spins;
+};
+
+// Spins like spin_pause_backoff until the spin would exceed `max_spins`, then
+// yields the CPU on every further failure. Unlike a sleep, a yield is free
+// when nobody else wants to run.
+template <size_t min_spins = 4, size_t max_spins = 256>
+class exp_yield_backoff {
+ public:
+  void operator()() {
+    lockfree_stats::add(stat_counter::backoffs);
+    if (spins_ > max_spins) {
+      std::this_thread::yield();
+      return;
+    }
+    for (size_t i = 0; i < spins_; ++i) {
+      cpu_relax();
+    }
+    spins_ *= 2;
+  }
+
+ private:
+  size_t spins_ = min_spins;
+};
+
+#endif  // MY_BACKOFF
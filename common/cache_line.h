@@ -0,0 +1,52 @@
+#ifndef MY_CACHE_LINE
+#define MY_CACHE_LINE
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#if defined(__cpp_lib_hardware_interference_size)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+constexpr size_t cache_line_size = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr size_t cache_line_size = 64;
+#endif
+
+// Alignment that gives a T a cache line of its own. Build with -DNO_PADDING
+// to get the old, tightly packed layout back and measure what the padding is
+// worth: everything aligned by it then falls back to its natural alignment.
+#if defined(NO_PADDING)
+template <typename T>
+constexpr size_t padded_alignment = alignof(T);
+#else
+template <typename T>
+constexpr size_t padded_alignment = cache_line_size;
+#endif
+
+// Value that owns a whole cache line, so neighbours in an array or a struct
+// never share it.
+template <typename T>
+struct alignas(padded_alignment<T>) padded {
+  T value;
+
+  padded() : value{} {}
+  template <typename... Args>
+  explicit padded(Args&&... args) : value(std::forward<Args>(args)...) {}
+};
+
+// Drop-in replacement for std::atomic<T> that owns a whole cache line.
+template <typename T>
+struct alignas(padded_alignment<std::atomic<T>>) padded_atomic
+    : std::atomic<T> {
+  using std::atomic<T>::atomic;
+  using std::atomic<T>::operator=;
+};
+
+#endif  // MY_CACHE_LINE
@@ -0,0 +1,123 @@
+#ifndef MY_FLAT_COMBINING
+#define MY_FLAT_COMBINING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cache_line.h"
+
+// Flat combining (Hendler, Incze, Shavit, Tzafrir): instead of every thread
+// taking the lock for its own operation, threads publish requests in
+// per-thread records and whoever gets the lock serves all pending ones in a
+// single pass. The protected structure stays in the combiner's cache and the
+// lock changes hands once per batch instead of once per operation.
+//
+// `combine(records, n)` is called under the lock with the pending records; it
+// must fill in `response` of every one of them.
+template <typename Request, typename Response>
+class flat_combining {
+ public:
+  struct alignas(cache_line_size) record {
+    std::atomic_bool pending = {false};
+    Request request;
+    Response response;
+  };
+
+  explicit flat_combining(size_t threads_num)
+      : records_(threads_num), batch_(threads_num + 1) {}
+
+  template <typename Combine>
+  Response execute(Request request, Combine&& combine);
+
+ private:
+  std::vector<record> records_;
+  // Only touched by the lock holder.
+  std::vector<record*> batch_;
+  padded_atomic<bool> locked_ = {false};
+  padded_atomic<size_t> registered_ = {0};
+  const uint64_t id_ = next_id();
+
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> counter = {0};
+    return counter.fetch_add(1, std::memory_order_relaxed);
+  }
+  record* my_record();
+  bool try_lock() {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+  }
+  template <typename Combine>
+  void combine_pending(Combine& combine, record* extra);
+};
+
+template <typename Request, typename Response>
+typename flat_combining<Request, Response>::record*
+flat_combining<Request, Response>::my_record() {
+  // Instances are told apart by id rather than by address, so a new combiner
+  // allocated where an old one lived does not inherit stale slots.
+  thread_local std::vector<std::pair<uint64_t, record*>> mine;
+  for (auto& entry : mine) {
+    if (entry.first == id_) {
+      return entry.second;
+    }
+  }
+  size_t index = registered_.fetch_add(1, std::memory_order_relaxed);
+  record* rec = index < records_.size() ? &records_[index] : nullptr;
+  mine.emplace_back(id_, rec);
+  return rec;
+}
+
+template <typename Request, typename Response>
+template <typename Combine>
+void flat_combining<Request, Response>::combine_pending(Combine& combine,
+                                                        record* extra) {
+  size_t n = 0;
+  if (extra) {
+    batch_[n++] = extra;
+  }
+  for (auto& rec : records_) {
+    if (rec.pending.load(std::memory_order_acquire)) {
+      batch_[n++] = &rec;
+    }
+  }
+  combine(batch_.data(), n);
+  for (size_t i = 0; i < n; ++i) {
+    batch_[i]->pending.store(false, std::memory_order_release);
+  }
+}
+
+template <typename Request, typename Response>
+template <typename Combine>
+Response flat_combining<Request, Response>::execute(Request request,
+                                                    Combine&& combine) {
+  record* rec = my_record();
+  if (!rec) {
+    // More threads than records: serve the request with a private record,
+    // picking up everybody else's on the way.
+    record local;
+    local.request = std::move(request);
+    while (!try_lock()) {
+      std::this_thread::yield();
+    }
+    combine_pending(combine, &local);
+    locked_.store(false, std::memory_order_release);
+    return std::move(local.response);
+  }
+  rec->request = std::move(request);
+  rec->pending.store(true, std::memory_order_release);
+  while (rec->pending.load(std::memory_order_acquire)) {
+    if (try_lock()) {
+      combine_pending(combine, nullptr);
+      locked_.store(false, std::memory_order_release);
+      break;
+    }
+    std::this_thread::yield();
+  }
+  return std::move(rec->response);
+}
+
+#endif  // MY_FLAT_COMBINING
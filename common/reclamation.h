@@ -0,0 +1,478 @@
+#ifndef MY_RECLAMATION
+#define MY_RECLAMATION
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cache_line.h"
+#include "slab_allocator.h"
+#include "stats.h"
+
+// Safe memory reclamation for the lock-free structures. A reclaimer decides
+// when a node that has been unlinked can really be freed, i.e. when no thread
+// can still be reading it. Every backend has the same interface:
+//
+//   auto guard = reclaimer.pin();  // before touching shared nodes
+//   node = reclaimer.protect(i, src);  // load a pointer that will be read
+//   reclaimer.retire(node, deleter);  // after unlinking `node`
+//   reclaimer.thread_slot();  // index of the calling thread, < capacity()
+//
+// so a structure takes the backend as a template parameter. protect() only
+// matters for hazard pointers; the other backends just load.
+//
+// `protects_whole_operation` says whether pin() alone keeps every node the
+// thread reaches alive until the guard is gone. Structures that traverse
+// without protect() require it. Such backends also have
+//
+//   reclaimer.pinned_epoch();  // epoch the calling thread is pinned in
+//
+// Nodes a thread reached while pinned in some epoch are still allocated
+// whenever it is pinned in that same epoch again, so it may keep pointers to
+// them between operations and use them only if the epoch has not changed.
+
+// Gives every thread that uses an object a slot index of its own. Slots are
+// claimed on first use and released when the thread exits, so a fixed array
+// of per-thread state can be indexed without locks or maps on the hot path.
+// If all slots are taken, a new thread waits until one is released.
+class thread_registry {
+ public:
+  explicit thread_registry(size_t capacity)
+      : in_use_(new padded_atomic<bool>[capacity]), capacity_(capacity) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      in_use_[i].store(false, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> guard(live().lock);
+    live().ids.insert(id_);
+  }
+  ~thread_registry() {
+    std::lock_guard<std::mutex> guard(live().lock);
+    live().ids.erase(id_);
+  }
+  thread_registry(const thread_registry&) = delete;
+  thread_registry& operator=(const thread_registry&) = delete;
+
+  size_t capacity() const { return capacity_; }
+  // Slots at and above this index have never been used.
+  size_t high_water_mark() const {
+    return high_water_mark_.load(std::memory_order_acquire);
+  }
+  size_t my_slot();
+
+ private:
+  struct entry {
+    uint64_t id;
+    thread_registry* registry;
+    size_t slot;
+  };
+  // Releases the calling thread's slots of all registries still alive.
+  struct thread_slots {
+    std::vector<entry> entries;
+    ~thread_slots();
+  };
+  struct live_registries {
+    std::mutex lock;
+    std::set<uint64_t> ids;
+  };
+
+  static live_registries& live() {
+    static live_registries* l = new live_registries;  // Outlives threads.
+    return *l;
+  }
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> counter = {0};
+    return counter.fetch_add(1, std::memory_order_relaxed);
+  }
+  size_t claim();
+
+  std::unique_ptr<padded_atomic<bool>[]> in_use_;
+  const size_t capacity_;
+  padded_atomic<size_t> high_water_mark_ = {0};
+  // Registries are told apart by id, not by address, which may be reused.
+  const uint64_t id_ = next_id();
+};
+
+inline thread_registry::thread_slots::~thread_slots() {
+  std::lock_guard<std::mutex> guard(live().lock);
+  for (auto& e : entries) {
+    if (live().ids.count(e.id)) {
+      e.registry->in_use_[e.slot].store(false, std::memory_order_release);
+    }
+  }
+}
+
+inline size_t thread_registry::claim() {
+  while (true) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      bool expected = false;
+      if (!in_use_[i].load(std::memory_order_relaxed) &&
+          in_use_[i].compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+        size_t mark = high_water_mark_.load(std::memory_order_relaxed);
+        while (mark < i + 1 &&
+               !high_water_mark_.compare_exchange_weak(
+                   mark, i + 1, std::memory_order_release,
+                   std::memory_order_relaxed)) {
+        }
+        return i;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+inline size_t thread_registry::my_slot() {
+  thread_local thread_slots mine;
+  for (const auto& e : mine.entries) {
+    if (e.id == id_) {
+      return e.slot;
+    }
+  }
+  size_t slot = claim();
+  mine.entries.push_back(entry{id_, this, slot});
+  return slot;
+}
+
+// Type-erased pointer waiting to be freed.
+struct retired_ptr {
+  void* ptr;
+  void (*deleter)(void*);
+
+  void reclaim() const { deleter(ptr); }
+};
+
+// Epoch-based reclamation (Fraser). A pinned thread announces the global epoch
+// it has seen; the epoch only advances once every pinned thread has caught up
+// with it. A node retired in epoch e is unreachable for everybody by the time
+// the global epoch reaches e + 2, so each thread keeps three limbo lists, one
+// per epoch modulo 3, and frees a whole list at once when it is reused.
+class epoch_reclaimer {
+  struct alignas(cache_line_size) thread_record {
+    // Announced epoch shifted left by one, lowest bit set while pinned.
+    std::atomic<uint64_t> state = {0};
+    // Everything below is only touched by the slot owner.
+    size_t nesting = 0;
+    size_t retired_since_advance = 0;
+    uint64_t limbo_epoch[3] = {0, 0, 0};
+    std::vector<retired_ptr> limbo[3];
+  };
+
+ public:
+  class guard {
+   public:
+    explicit guard(epoch_reclaimer* owner) : owner_(owner) {}
+    guard(guard&& other) noexcept : owner_(other.owner_) {
+      other.owner_ = nullptr;
+    }
+    guard(const guard&) = delete;
+    guard& operator=(const guard&) = delete;
+    ~guard() {
+      if (owner_) {
+        owner_->unpin();
+      }
+    }
+
+   private:
+    epoch_reclaimer* owner_;
+  };
+
+  static constexpr size_t default_max_threads = 256;
+  static constexpr bool protects_whole_operation = true;
+  // Retires between two attempts to advance the epoch.
+  static constexpr size_t advance_period = 64;
+
+  explicit epoch_reclaimer(size_t max_threads = default_max_threads)
+      : registry_(max_threads), records_(new thread_record[max_threads]) {}
+  ~epoch_reclaimer() {
+    for (size_t i = 0; i < registry_.capacity(); ++i) {
+      for (auto& list : records_[i].limbo) {
+        for (const auto& r : list) {
+          r.reclaim();
+        }
+      }
+    }
+  }
+
+  guard pin();
+  template <typename P>
+  P* protect(size_t, const std::atomic<P*>& src) {
+    return src.load(std::memory_order_acquire);
+  }
+  void retire(void* ptr, void (*deleter)(void*));
+  // Must be called pinned.
+  uint64_t pinned_epoch() {
+    return records_[registry_.my_slot()].state.load(
+               std::memory_order_relaxed) >>
+           1;
+  }
+  size_t thread_slot() { return registry_.my_slot(); }
+  size_t capacity() const { return registry_.capacity(); }
+
+ private:
+  void unpin();
+  void try_advance(uint64_t epoch);
+  void reclaim_expired(thread_record& rec, uint64_t epoch);
+
+  thread_registry registry_;
+  std::unique_ptr<thread_record[]> records_;
+  padded_atomic<uint64_t> global_epoch_ = {2};
+};
+
+inline epoch_reclaimer::guard epoch_reclaimer::pin() {
+  thread_record& rec = records_[registry_.my_slot()];
+  if (rec.nesting++ == 0) {
+    const uint64_t epoch = global_epoch_.load(std::memory_order_relaxed);
+    rec.state.store((epoch << 1) | 1, std::memory_order_relaxed);
+    // Announce before reading any shared node.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  return guard(this);
+}
+
+inline void epoch_reclaimer::unpin() {
+  thread_record& rec = records_[registry_.my_slot()];
+  if (--rec.nesting == 0) {
+    rec.state.store(0, std::memory_order_release);
+  }
+}
+
+inline void epoch_reclaimer::try_advance(uint64_t epoch) {
+  lockfree_stats::add(stat_counter::reclaimer_scans);
+  const size_t slots = registry_.high_water_mark();
+  for (size_t i = 0; i < slots; ++i) {
+    const uint64_t state = records_[i].state.load(std::memory_order_seq_cst);
+    if ((state & 1) && (state >> 1) != epoch) {
+      return;
+    }
+  }
+  global_epoch_.compare_exchange_strong(epoch, epoch + 1,
+                                        std::memory_order_acq_rel);
+}
+
+inline void epoch_reclaimer::reclaim_expired(thread_record& rec,
+                                             uint64_t epoch) {
+  for (size_t i = 0; i < 3; ++i) {
+    if (rec.limbo_epoch[i] + 2 <= epoch && !rec.limbo[i].empty()) {
+      for (const auto& r : rec.limbo[i]) {
+        r.reclaim();
+      }
+      lockfree_stats::add(stat_counter::reclaimed, rec.limbo[i].size());
+      // clear() keeps the capacity, so refilling does not allocate.
+      rec.limbo[i].clear();
+    }
+  }
+}
+
+inline void epoch_reclaimer::retire(void* ptr, void (*deleter)(void*)) {
+  thread_record& rec = records_[registry_.my_slot()];
+  uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+  if (++rec.retired_since_advance >= advance_period) {
+    rec.retired_since_advance = 0;
+    try_advance(epoch);
+    epoch = global_epoch_.load(std::memory_order_acquire);
+  }
+  reclaim_expired(rec, epoch);
+  const size_t bucket = epoch % 3;
+  rec.limbo_epoch[bucket] = epoch;
+  rec.limbo[bucket].push_back(retired_ptr{ptr, deleter});
+  lockfree_stats::add(stat_counter::retired);
+  lockfree_stats::record_max(
+      stat_counter::retired_list_max,
+      rec.limbo[0].size() + rec.limbo[1].size() + rec.limbo[2].size());
+}
+
+// Hazard pointers (Michael). Before reading a node a thread publishes its
+// address in one of its hazard slots and checks that the node is still
+// reachable; a retired node is freed only once no slot holds it. Retired
+// nodes are collected per thread and scanned in batches proportional to the
+// number of hazard slots, so each scan frees a constant fraction of the batch
+// and the cost per node is O(1) amortized.
+class hazard_pointer_reclaimer {
+ public:
+  static constexpr size_t hazards_per_thread = 3;
+  // Only what protect() has published is safe.
+  static constexpr bool protects_whole_operation = false;
+
+ private:
+  struct alignas(cache_line_size) thread_record {
+    std::atomic<void*> hazards[hazards_per_thread] = {};
+    // Only touched by the slot owner.
+    std::vector<retired_ptr> retired;
+    std::vector<void*> scan_buffer;
+  };
+
+ public:
+  // Clears the thread's hazard slots when the operation is over.
+  class guard {
+   public:
+    explicit guard(thread_record* rec) : rec_(rec) {}
+    guard(guard&& other) noexcept : rec_(other.rec_) { other.rec_ = nullptr; }
+    guard(const guard&) = delete;
+    guard& operator=(const guard&) = delete;
+    ~guard() {
+      if (rec_) {
+        for (auto& hazard : rec_->hazards) {
+          hazard.store(nullptr, std::memory_order_release);
+        }
+      }
+    }
+
+   private:
+    thread_record* rec_;
+  };
+
+  explicit hazard_pointer_reclaimer(
+      size_t max_threads = epoch_reclaimer::default_max_threads)
+      : registry_(max_threads), records_(new thread_record[max_threads]) {}
+  ~hazard_pointer_reclaimer() {
+    for (size_t i = 0; i < registry_.capacity(); ++i) {
+      for (const auto& r : records_[i].retired) {
+        r.reclaim();
+      }
+    }
+  }
+
+  guard pin() { return guard(&records_[registry_.my_slot()]); }
+  template <typename P>
+  P* protect(size_t index, const std::atomic<P*>& src);
+  void retire(void* ptr, void (*deleter)(void*));
+  size_t thread_slot() { return registry_.my_slot(); }
+  size_t capacity() const { return registry_.capacity(); }
+
+ private:
+  void scan(thread_record& rec);
+
+  thread_registry registry_;
+  std::unique_ptr<thread_record[]> records_;
+};
+
+template <typename P>
+P* hazard_pointer_reclaimer::protect(size_t index, const std::atomic<P*>& src) {
+  auto& hazard = records_[registry_.my_slot()].hazards[index];
+  P* p = src.load(std::memory_order_relaxed);
+  while (true) {
+    hazard.store(p, std::memory_order_seq_cst);
+    // Still reachable after the hazard became visible, so nobody can have
+    // freed it in between.
+    P* again = src.load(std::memory_order_seq_cst);
+    if (again == p) {
+      return p;
+    }
+    p = again;
+  }
+}
+
+inline void hazard_pointer_reclaimer::retire(void* ptr,
+                                             void (*deleter)(void*)) {
+  thread_record& rec = records_[registry_.my_slot()];
+  rec.retired.push_back(retired_ptr{ptr, deleter});
+  lockfree_stats::add(stat_counter::retired);
+  lockfree_stats::record_max(stat_counter::retired_list_max,
+                             rec.retired.size());
+  const size_t threshold = std::max<size_t>(
+      64, 2 * hazards_per_thread * registry_.high_water_mark());
+  if (rec.retired.size() >= threshold) {
+    scan(rec);
+  }
+}
+
+inline void hazard_pointer_reclaimer::scan(thread_record& rec) {
+  lockfree_stats::add(stat_counter::reclaimer_scans);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto& hazards = rec.scan_buffer;
+  hazards.clear();
+  const size_t slots = registry_.high_water_mark();
+  for (size_t i = 0; i < slots; ++i) {
+    for (const auto& hazard : records_[i].hazards) {
+      if (void* p = hazard.load(std::memory_order_acquire)) {
+        hazards.push_back(p);
+      }
+    }
+  }
+  std::sort(hazards.begin(), hazards.end());
+  // Compact the survivors in place, the vectors keep their capacity.
+  size_t kept = 0;
+  for (const auto& r : rec.retired) {
+    if (std::binary_search(hazards.begin(), hazards.end(), r.ptr)) {
+      rec.retired[kept++] = r;
+    } else {
+      r.reclaim();
+    }
+  }
+  lockfree_stats::add(stat_counter::reclaimed, rec.retired.size() - kept);
+  rec.retired.resize(kept);
+}
+
+// Frees nothing until the reclaimer itself is destroyed. Costs a single
+// atomic exchange per retire and no per-read work, useful as a baseline and
+// for structures that only grow.
+class deferred_reclaimer {
+  struct retired_node {
+    retired_ptr retired;
+    retired_node* next;
+
+    static void* operator new(size_t size) {
+      return slab_allocator::allocate(size);
+    }
+    static void operator delete(void* p, size_t size) {
+      slab_allocator::deallocate(p, size);
+    }
+  };
+
+ public:
+  struct guard {};
+
+  static constexpr bool protects_whole_operation = true;
+
+  explicit deferred_reclaimer(
+      size_t max_threads = epoch_reclaimer::default_max_threads)
+      : registry_(max_threads) {}
+  ~deferred_reclaimer() {
+    retired_node* cur = retired_.load(std::memory_order_acquire);
+    while (cur) {
+      retired_node* next = cur->next;
+      cur->retired.reclaim();
+      delete cur;
+      cur = next;
+    }
+  }
+
+  guard pin() { return guard{}; }
+  template <typename P>
+  P* protect(size_t, const std::atomic<P*>& src) {
+    return src.load(std::memory_order_acquire);
+  }
+  // Nothing is freed early, so there is only ever one epoch.
+  uint64_t pinned_epoch() const { return 0; }
+  size_t thread_slot() { return registry_.my_slot(); }
+  size_t capacity() const { return registry_.capacity(); }
+  void retire(void* ptr, void (*deleter)(void*)) {
+    lockfree_stats::add(stat_counter::retired);
+    auto* node = new retired_node{retired_ptr{ptr, deleter},
+                                  retired_.load(std::memory_order_relaxed)};
+    while (!retired_.compare_exchange_weak(node->next, node,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  thread_registry registry_;
+  std::atomic<retired_node*> retired_ = {nullptr};
+};
+
+// How many threads the reclaimer of a structure serves at once, for structures
+// that build their reclaimer themselves. A type of its own, so that it cannot
+// be passed where some other number was meant.
+struct reclaimer_capacity {
+  size_t threads = epoch_reclaimer::default_max_threads;
+};
+
+#endif  // MY_RECLAMATION
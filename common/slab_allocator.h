@@ -0,0 +1,228 @@
+#ifndef MY_SLAB_ALLOCATOR
+#define MY_SLAB_ALLOCATOR
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "cache_line.h"
+
+// Size-class slab allocator for the nodes of the concurrent structures.
+//
+// Every thread allocates from its own heap: a free list per size class, filled
+// from 64 KiB slabs. A block freed by the thread that owns its slab goes back
+// to that free list; a block freed by any other thread is pushed onto the
+// owner's lock-free remote list, which the owner drains in one exchange when
+// its local list runs dry. Once the heaps are warm, neither path calls malloc
+// or free.
+//
+// Slabs are never returned to the system. A heap whose thread exits goes to a
+// pool and is adopted by the next new thread, together with its free blocks.
+class slab_allocator {
+ public:
+  static constexpr size_t slab_size = 64 * 1024;
+  static constexpr size_t min_block = 16;
+  static constexpr size_t max_block = 4096;
+  static constexpr size_t classes_num = 9;  // 16, 32, ..., 4096
+
+  static void* allocate(size_t size);
+  static void deallocate(void* p, size_t size);
+
+ private:
+  struct free_block {
+    free_block* next;
+  };
+
+  struct heap;
+
+  struct alignas(cache_line_size) slab_header {
+    heap* owner;
+  };
+
+  struct size_class {
+    free_block* local = nullptr;
+    char* bump = nullptr;
+    char* bump_end = nullptr;
+  };
+
+  struct heap {
+    size_class classes[classes_num];
+    padded_atomic<free_block*> remote[classes_num] = {};
+  };
+
+  struct heap_pool {
+    std::mutex lock;
+    std::vector<heap*> idle;
+  };
+
+  // Gives the heap back to the pool when its thread exits.
+  struct heap_holder {
+    ~heap_holder();
+  };
+
+  static heap_pool& pool() {
+    static heap_pool* p = new heap_pool;  // Outlives every thread_local.
+    return *p;
+  }
+  // Kept outside of `holder`, so that it can still be read, and has been
+  // cleared, when other thread_local destructors run after it.
+  static thread_local heap* thread_heap;
+  static thread_local heap_holder holder;
+  static thread_local bool holder_destroyed;
+
+  static heap* my_heap();
+  static void give_back(heap* h);
+  static size_t class_of(size_t size);
+  static size_t block_size(size_t cls) { return min_block << cls; }
+  static slab_header* slab_of(void* p) {
+    return reinterpret_cast<slab_header*>(reinterpret_cast<uintptr_t>(p) &
+                                          ~(slab_size - 1));
+  }
+  static void* refill(heap* h, size_t cls);
+  static void* take_block(heap* h, size_t cls);
+};
+
+inline thread_local slab_allocator::heap* slab_allocator::thread_heap = nullptr;
+inline thread_local slab_allocator::heap_holder slab_allocator::holder;
+inline thread_local bool slab_allocator::holder_destroyed = false;
+
+inline slab_allocator::heap_holder::~heap_holder() {
+  holder_destroyed = true;
+  if (thread_heap) {
+    give_back(thread_heap);
+    // The heap may be adopted by another thread right away. Frees that come
+    // later from this thread's teardown must take the remote path, and
+    // allocations borrow a heap of their own.
+    thread_heap = nullptr;
+  }
+}
+
+inline void slab_allocator::give_back(heap* h) {
+  std::lock_guard<std::mutex> guard(pool().lock);
+  pool().idle.push_back(h);
+}
+
+inline slab_allocator::heap* slab_allocator::my_heap() {
+  if (thread_heap) {
+    return thread_heap;
+  }
+  heap* h = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(pool().lock);
+    if (!pool().idle.empty()) {
+      h = pool().idle.back();
+      pool().idle.pop_back();
+    }
+  }
+  if (!h) {
+    h = new heap;
+  }
+  // During thread teardown there is nobody left to give the heap back; the
+  // caller returns it to the pool right after using it.
+  if (!holder_destroyed) {
+    thread_heap = h;
+    // Registers the destructor that gives it back.
+    (void)&holder;
+  }
+  return h;
+}
+
+inline size_t slab_allocator::class_of(size_t size) {
+  size_t cls = 0;
+  while (block_size(cls) < size) {
+    ++cls;
+  }
+  return cls;
+}
+
+inline void* slab_allocator::refill(heap* h, size_t cls) {
+  size_class& sc = h->classes[cls];
+  // Blocks freed by other threads come back in one go.
+  free_block* remote =
+      h->remote[cls].exchange(nullptr, std::memory_order_acquire);
+  if (remote) {
+    sc.local = remote->next;
+    return remote;
+  }
+  const size_t size = block_size(cls);
+  if (sc.bump == sc.bump_end) {
+    void* raw = std::aligned_alloc(slab_size, slab_size);
+    if (!raw) {
+      throw std::bad_alloc();
+    }
+    auto* header = new (raw) slab_header{h};
+    char* begin = static_cast<char*>(raw);
+    // Blocks start at a multiple of their size, which keeps them aligned.
+    size_t offset = (sizeof(*header) + size - 1) / size * size;
+    sc.bump = begin + offset;
+    sc.bump_end = begin + slab_size;
+  }
+  void* block = sc.bump;
+  sc.bump += size;
+  return block;
+}
+
+inline void* slab_allocator::allocate(size_t size) {
+  if (size > max_block) {
+    return ::operator new(size);
+  }
+  const size_t cls = class_of(size);
+  heap* h = my_heap();
+  void* block = take_block(h, cls);
+  if (!thread_heap) {
+    // A late allocation during thread teardown, `h` was only borrowed.
+    give_back(h);
+  }
+  return block;
+}
+
+inline void* slab_allocator::take_block(heap* h, size_t cls) {
+  size_class& sc = h->classes[cls];
+  if (sc.local) {
+    free_block* block = sc.local;
+    sc.local = block->next;
+    return block;
+  }
+  return refill(h, cls);
+}
+
+inline void slab_allocator::deallocate(void* p, size_t size) {
+  if (!p) {
+    return;
+  }
+  if (size > max_block) {
+    ::operator delete(p);
+    return;
+  }
+  const size_t cls = class_of(size);
+  heap* owner = slab_of(p)->owner;
+  auto* block = static_cast<free_block*>(p);
+  if (owner == thread_heap) {
+    block->next = owner->classes[cls].local;
+    owner->classes[cls].local = block;
+    return;
+  }
+  // Push-only list with a single consumer that takes everything at once, so
+  // there is no ABA to worry about.
+  auto& remote = owner->remote[cls];
+  block->next = remote.load(std::memory_order_relaxed);
+  while (!remote.compare_exchange_weak(block->next, block,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+  }
+}
+
+// Same interface on top of the global operator new, for structures that take
+// their allocator as a parameter: to measure what the slabs are worth, or to
+// run under a sanitizer that has to see every allocation.
+struct heap_allocator {
+  static void* allocate(size_t size) { return ::operator new(size); }
+  static void deallocate(void* p, size_t) { ::operator delete(p); }
+};
+
+#endif  // MY_SLAB_ALLOCATOR
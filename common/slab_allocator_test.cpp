@@ -0,0 +1,71 @@
+// g++ -O2 -std=c++17 -pthread common/slab_allocator_test.cpp && ./a.out
+//
+// A thread exits, its heap goes back to the pool and another thread adopts
+// it, while a thread_local destructor of the exiting thread still allocates
+// and frees. The late calls must not touch the adopted heap's local lists.
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "slab_allocator.h"
+
+constexpr size_t block = 64;
+
+std::atomic<int> stage = {0};
+void* exited_block = nullptr;
+void* late_block = nullptr;
+void* adopted_block = nullptr;
+
+uintptr_t slab_of(void* p) {
+  return reinterpret_cast<uintptr_t>(p) & ~(slab_allocator::slab_size - 1);
+}
+
+void wait_for(int value) {
+  while (stage.load() < value) {
+    std::this_thread::yield();
+  }
+}
+
+// Destroyed after the allocator has given the exiting thread's heap back.
+struct late_user {
+  ~late_user() {
+    stage.store(1);
+    wait_for(2);
+    late_block = slab_allocator::allocate(block);
+    slab_allocator::deallocate(exited_block, block);
+    slab_allocator::deallocate(late_block, block);
+  }
+};
+
+int main() {
+  std::thread exiting([] {
+    // Constructed before the thread's first allocation, so it is destroyed
+    // after it. A block-scope thread_local, because those at namespace scope
+    // are all constructed together on the first access to any of them.
+    thread_local late_user late;
+    (void)late;
+    exited_block = slab_allocator::allocate(block);
+  });
+  std::thread adopting([&] {
+    wait_for(1);
+    adopted_block = slab_allocator::allocate(block);
+    stage.store(2);
+    exiting.join();
+    // The block freed by the exited thread comes back through the remote
+    // list of the heap this thread has adopted.
+    void* reused = slab_allocator::allocate(block);
+    assert(reused == exited_block);
+    slab_allocator::deallocate(reused, block);
+    slab_allocator::deallocate(adopted_block, block);
+  });
+  adopting.join();
+
+  assert(slab_of(adopted_block) == slab_of(exited_block));
+  // The late allocation was served by another heap, not the adopted one.
+  assert(slab_of(late_block) != slab_of(adopted_block));
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+#ifndef MY_STATS
+#define MY_STATS
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "cache_line.h"
+
+// Contention counters for the lock-free structures, compiled in with
+// -DLOCKFREE_STATS. Without it every call below is an empty inline function
+// and costs nothing.
+//
+// Each thread bumps counters of its own, padded to whole cache lines, with a
+// plain load and store: there is a single writer, so no locked instruction
+// and no sharing. collect() sums them over all threads on demand; it may run
+// concurrently with the writers and then sees each counter at some recent
+// value.
+enum class stat_counter : size_t {
+  // Failed CAS on the top of lockfree_stack.
+  stack_push_cas_failures,
+  stack_pop_cas_failures,
+  // Operations completed through the elimination array instead.
+  stack_eliminations,
+  // Failed CAS while linking or marking a skiplist node.
+  skiplist_add_cas_failures,
+  skiplist_remove_cas_failures,
+  // Searches restarted from the top after losing a race to unlink a node.
+  skiplist_find_restarts,
+  // Calls of a backoff policy (common/backoff.h).
+  backoffs,
+  // Passes of a reclaimer over all threads' records: hazard pointer scans
+  // and attempts to advance the epoch.
+  reclaimer_scans,
+  retired,
+  reclaimed,
+  // Longest retired list, or sum of limbo lists, any thread has had.
+  retired_list_max,
+  counters_num
+};
+
+constexpr size_t stat_counters_num =
+    static_cast<size_t>(stat_counter::counters_num);
+
+inline const char* stat_name(size_t counter) {
+  static const char* const names[stat_counters_num] = {
+      "stack_push_cas_failures",
+      "stack_pop_cas_failures",
+      "stack_eliminations",
+      "skiplist_add_cas_failures",
+      "skiplist_remove_cas_failures",
+      "skiplist_find_restarts",
+      "backoffs",
+      "reclaimer_scans",
+      "retired",
+      "reclaimed",
+      "retired_list_max"};
+  return names[counter];
+}
+
+class lockfree_stats {
+ public:
+#if defined(LOCKFREE_STATS)
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+  using snapshot = std::array<uint64_t, stat_counters_num>;
+
+  static void add(stat_counter counter, uint64_t n = 1) {
+#if defined(LOCKFREE_STATS)
+    std::atomic<uint64_t>& value = mine().values[index(counter)];
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+#else
+    (void)counter;
+    (void)n;
+#endif
+  }
+  static void record_max(stat_counter counter, uint64_t value) {
+#if defined(LOCKFREE_STATS)
+    std::atomic<uint64_t>& max = mine().values[index(counter)];
+    if (value > max.load(std::memory_order_relaxed)) {
+      max.store(value, std::memory_order_relaxed);
+    }
+#else
+    (void)counter;
+    (void)value;
+#endif
+  }
+
+  // Totals over every thread that has ever counted anything; maxima for
+  // retired_list_max. All zero when stats are compiled out.
+  static snapshot collect() {
+    snapshot result = {};
+#if defined(LOCKFREE_STATS)
+    std::lock_guard<std::mutex> guard(all().lock);
+    for (const thread_counters* counters : all().threads) {
+      for (size_t i = 0; i < stat_counters_num; ++i) {
+        uint64_t value = counters->values[i].load(std::memory_order_relaxed);
+        result[i] = is_max(i) ? std::max(result[i], value) : result[i] + value;
+      }
+    }
+#endif
+    return result;
+  }
+  // What has been counted since `before` was collected.
+  static snapshot since(const snapshot& before) {
+    snapshot result = collect();
+    for (size_t i = 0; i < stat_counters_num; ++i) {
+      if (!is_max(i)) {
+        result[i] -= before[i];
+      }
+    }
+    return result;
+  }
+
+ private:
+  struct alignas(cache_line_size) thread_counters {
+    std::atomic<uint64_t> values[stat_counters_num] = {};
+  };
+  // Counters of exited threads are kept, so that their counts still add up.
+  struct all_counters {
+    std::mutex lock;
+    std::vector<thread_counters*> threads;
+  };
+
+  static constexpr size_t index(stat_counter counter) {
+    return static_cast<size_t>(counter);
+  }
+  static constexpr bool is_max(size_t counter) {
+    return counter == index(stat_counter::retired_list_max);
+  }
+  static all_counters& all() {
+    static all_counters* a = new all_counters;  // Outlives threads.
+    return *a;
+  }
+  static thread_counters& mine() {
+    thread_local thread_counters* counters = enroll();
+    return *counters;
+  }
+  static thread_counters* enroll() {
+    auto* counters = new thread_counters;
+    std::lock_guard<std::mutex> guard(all().lock);
+    all().threads.push_back(counters);
+    return counters;
+  }
+};
+
+#endif  // MY_STATS
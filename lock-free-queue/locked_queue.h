@@ -0,0 +1,44 @@
+#ifndef LOCKED_QUEUE_H
+#define LOCKED_QUEUE_H
+
+#include <cstddef>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+// std::queue behind a mutex, the baseline for mpmc_queue. Bounded the same
+// way, so both refuse elements at the same fill level.
+template <typename T>
+class locked_queue {
+ public:
+  explicit locked_queue(size_t capacity) : capacity_(capacity) {}
+
+  bool try_enqueue(const T& val) { return emplace(val); }
+  bool try_enqueue(T&& val) { return emplace(std::move(val)); }
+  bool try_dequeue(T& out) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (queue_.empty()) {
+      return false;
+    }
+    out = std::move(queue_.front());
+    queue_.pop();
+    return true;
+  }
+
+ private:
+  template <typename U>
+  bool emplace(U&& val) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (queue_.size() >= capacity_) {
+      return false;
+    }
+    queue_.push(std::forward<U>(val));
+    return true;
+  }
+
+  std::mutex lock_;
+  std::queue<T> queue_;
+  size_t capacity_;
+};
+
+#endif  // LOCKED_QUEUE_H
@@ -0,0 +1,202 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "../common/cache_line.h"
+
+// Bounded multi-producer multi-consumer queue after Dmitry Vyukov. Every cell
+// carries a sequence number telling whose turn it is: a producer may fill cell
+// `pos % capacity` once its sequence equals `pos`, a consumer may empty it
+// once the sequence equals `pos + 1`. Producers and consumers only compete
+// among themselves for `tail_` and `head_` respectively, and no operation
+// allocates.
+template <typename T>
+class mpmc_queue {
+ public:
+  // `capacity` is rounded up to a power of two.
+  explicit mpmc_queue(size_t capacity);
+  ~mpmc_queue();
+
+  bool try_enqueue(const T& val) { return emplace(val); }
+  bool try_enqueue(T&& val) { return emplace(std::move(val)); }
+  bool try_dequeue(T& out);
+  // Claim up to as many consecutive cells as are free with a single CAS and
+  // fill them from [first, last). Returns how many elements were enqueued.
+  template <typename ForwardIt>
+  size_t try_enqueue_bulk(ForwardIt first, ForwardIt last);
+  // Moves up to `n` elements to `out`, claiming their cells with one CAS.
+  template <typename OutputIt>
+  size_t try_dequeue_bulk(OutputIt out, size_t n);
+
+ private:
+  struct cell {
+    std::atomic_size_t sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* value() { return reinterpret_cast<T*>(storage); }
+  };
+
+  template <typename U>
+  bool emplace(U&& val);
+  // Number of consecutive cells from `pos` on whose sequence is `pos + shift`,
+  // at most `n`.
+  size_t ready_run(size_t pos, size_t shift, size_t n);
+
+  const size_t mask_;
+  std::unique_ptr<cell[]> cells_;
+  padded_atomic<size_t> tail_ = {0};
+  padded_atomic<size_t> head_ = {0};
+};
+
+template <typename T>
+mpmc_queue<T>::mpmc_queue(size_t capacity)
+    : mask_([capacity] {
+        size_t size = 2;
+        while (size < capacity) {
+          size *= 2;
+        }
+        return size - 1;
+      }()),
+      cells_(new cell[mask_ + 1]) {
+  for (size_t i = 0; i <= mask_; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+mpmc_queue<T>::~mpmc_queue() {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  for (size_t pos = head_.load(std::memory_order_relaxed); pos != tail;
+       ++pos) {
+    cells_[pos & mask_].value()->~T();
+  }
+}
+
+template <typename T>
+template <typename U>
+bool mpmc_queue<T>::emplace(U&& val) {
+  size_t pos = tail_.load(std::memory_order_relaxed);
+  while (true) {
+    cell& c = cells_[pos & mask_];
+    size_t seq = c.sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        new (c.storage) T(std::forward<U>(val));
+        c.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // Full.
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T>
+bool mpmc_queue<T>::try_dequeue(T& out) {
+  size_t pos = head_.load(std::memory_order_relaxed);
+  while (true) {
+    cell& c = cells_[pos & mask_];
+    size_t seq = c.sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        out = std::move(*c.value());
+        c.value()->~T();
+        c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // Empty.
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T>
+size_t mpmc_queue<T>::ready_run(size_t pos, size_t shift, size_t n) {
+  size_t run = 0;
+  while (run < n && cells_[(pos + run) & mask_].sequence.load(
+                        std::memory_order_acquire) == pos + run + shift) {
+    ++run;
+  }
+  return run;
+}
+
+template <typename T>
+template <typename ForwardIt>
+size_t mpmc_queue<T>::try_enqueue_bulk(ForwardIt first, ForwardIt last) {
+  const auto wanted = static_cast<size_t>(std::distance(first, last));
+  if (wanted == 0) {
+    return 0;
+  }
+  size_t pos = tail_.load(std::memory_order_relaxed);
+  size_t run;
+  while (true) {
+    run = ready_run(pos, 0, std::min(wanted, mask_ + 1));
+    if (run == 0) {
+      size_t seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+      if (static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos) < 0) {
+        return 0;  // Full.
+      }
+      pos = tail_.load(std::memory_order_relaxed);
+      continue;
+    }
+    if (tail_.compare_exchange_weak(pos, pos + run,
+                                    std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  for (size_t i = 0; i < run; ++i, ++first) {
+    cell& c = cells_[(pos + i) & mask_];
+    new (c.storage) T(*first);
+    c.sequence.store(pos + i + 1, std::memory_order_release);
+  }
+  return run;
+}
+
+template <typename T>
+template <typename OutputIt>
+size_t mpmc_queue<T>::try_dequeue_bulk(OutputIt out, size_t n) {
+  if (n == 0) {
+    return 0;
+  }
+  size_t pos = head_.load(std::memory_order_relaxed);
+  size_t run;
+  while (true) {
+    run = ready_run(pos, 1, std::min(n, mask_ + 1));
+    if (run == 0) {
+      size_t seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+      if (static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1) < 0) {
+        return 0;  // Empty.
+      }
+      pos = head_.load(std::memory_order_relaxed);
+      continue;
+    }
+    if (head_.compare_exchange_weak(pos, pos + run,
+                                    std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  for (size_t i = 0; i < run; ++i) {
+    cell& c = cells_[(pos + i) & mask_];
+    *out = std::move(*c.value());
+    ++out;
+    c.value()->~T();
+    c.sequence.store(pos + i + 1 + mask_, std::memory_order_release);
+  }
+  return run;
+}
+
+#endif  // MPMC_QUEUE_H
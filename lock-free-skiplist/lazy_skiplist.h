@@ -0,0 +1,324 @@
+#ifndef MY_LAZY_SKIPLIST
+#define MY_LAZY_SKIPLIST
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <random>
+
+#include "../common/backoff.h"
+#include "../common/cache_line.h"
+#include "../common/reclamation.h"
+#include "../common/slab_allocator.h"
+
+// Lazy skiplist (Herlihy, Lev, Luchangco, Shavit): the lock-based counterpart
+// of LockFreeSkiplist, with the same template parameters.
+//
+// add() and remove() search without locks, then lock only the predecessors
+// they are about to change and validate that nothing moved in between; if
+// something did, they unlock and search again. A node is first marked as
+// removed, which is the linearization point, and only then unlinked. Searches
+// and contains() take no locks and never retry, so contains() is wait-free.
+//
+// Locks are taken bottom-up, i.e. from larger keys to smaller ones, and a
+// remover locks its victim before the predecessors, so there is a single
+// global order and no deadlock.
+//
+// Searches only pin(), so `Reclaimer` has to be one that protects whatever a
+// pinned thread reaches, as for LockFreeSkiplist.
+template <typename T, ssize_t MaxLevel = 32, typename Compare = std::less<T>,
+          typename BackoffPolicy = exp_yield_backoff<>,
+          typename Allocator = slab_allocator,
+          typename Reclaimer = epoch_reclaimer>
+class LazySkiplist {
+ private:
+  class Node;
+  static_assert(Reclaimer::protects_whole_operation,
+                "searches never call protect(), the reclaimer must keep "
+                "nodes alive for as long as a thread is pinned");
+  static constexpr ssize_t max_level = MaxLevel;
+
+ public:
+  explicit LazySkiplist(const Compare& comp = Compare())
+      : LazySkiplist(reclaimer_capacity(), comp) {}
+  explicit LazySkiplist(reclaimer_capacity capacity,
+                        const Compare& comp = Compare())
+      : reclaimer(capacity.threads),
+        height(0),
+        comp(comp),
+        head(Node::create_sentinel(max_level)),
+        tail(Node::create_sentinel(max_level)) {
+    for (ssize_t i = 0; i <= max_level; ++i) {
+      head->next[i].store(tail, std::memory_order_relaxed);
+    }
+  }
+  ~LazySkiplist() {
+    Node* cur = head->next[0].load(std::memory_order_relaxed);
+    while (cur != tail) {
+      Node* next = cur->next[0].load(std::memory_order_relaxed);
+      Node::destroy(cur);
+      cur = next;
+    }
+    Node::destroy_sentinel(head);
+    Node::destroy_sentinel(tail);
+  }
+
+  bool add(const T& val) {
+    auto guard = reclaimer.pin();
+    ssize_t top_level = random_level();
+    raise_height(top_level);
+    Node* preds[max_level + 1];
+    Node* succs[max_level + 1];
+    BackoffPolicy backoff;
+    while (true) {
+      ssize_t found_level = find(val, preds, succs, top_level);
+      if (found_level != -1) {
+        Node* found = succs[found_level];
+        if (!found->marked.load(std::memory_order_acquire)) {
+          // Somebody else is adding it; it counts as added once linked.
+          while (!found->fully_linked.load(std::memory_order_acquire)) {
+            backoff();
+          }
+          return false;
+        }
+        // Being removed, wait until it is gone.
+        backoff();
+        continue;
+      }
+      ssize_t locked_level = -1;
+      bool valid = true;
+      for (ssize_t level = 0; valid && level <= top_level; ++level) {
+        Node* pred = preds[level];
+        Node* succ = succs[level];
+        if (level == 0 || pred != preds[level - 1]) {
+          pred->lock();
+        }
+        locked_level = level;
+        valid = !pred->marked.load(std::memory_order_acquire) &&
+                !succ->marked.load(std::memory_order_acquire) &&
+                pred->next[level].load(std::memory_order_acquire) == succ;
+      }
+      if (!valid) {
+        unlock(preds, locked_level);
+        backoff();
+        continue;
+      }
+      Node* new_node = Node::create(val, top_level);
+      for (ssize_t level = 0; level <= top_level; ++level) {
+        new_node->next[level].store(succs[level], std::memory_order_relaxed);
+      }
+      for (ssize_t level = 0; level <= top_level; ++level) {
+        preds[level]->next[level].store(new_node, std::memory_order_release);
+      }
+      new_node->fully_linked.store(true, std::memory_order_release);
+      unlock(preds, locked_level);
+      return true;
+    }
+  }
+
+  bool remove(const T& val) {
+    auto guard = reclaimer.pin();
+    Node* preds[max_level + 1];
+    Node* succs[max_level + 1];
+    Node* victim = nullptr;
+    bool is_marked = false;
+    ssize_t top_level = 0;
+    BackoffPolicy backoff;
+    while (true) {
+      ssize_t found_level = find(val, preds, succs, top_level);
+      if (found_level != -1) {
+        victim = succs[found_level];
+      }
+      // Only a node that is fully linked is in its final shape and may be
+      // removed.
+      if (!is_marked &&
+          (found_level == -1 ||
+           !victim->fully_linked.load(std::memory_order_acquire) ||
+           victim->marked.load(std::memory_order_acquire))) {
+        return false;
+      }
+      if (victim->top_level > found_level) {
+        // The search started below the victim's top level because it read
+        // height before the victim was linked. Having seen the victim, the
+        // next search cannot.
+        top_level = victim->top_level;
+        continue;
+      }
+      if (!is_marked) {
+        top_level = victim->top_level;
+        victim->lock();
+        if (victim->marked.load(std::memory_order_relaxed)) {
+          victim->unlock();
+          return false;
+        }
+        victim->marked.store(true, std::memory_order_release);
+        is_marked = true;
+      }
+      ssize_t locked_level = -1;
+      bool valid = true;
+      for (ssize_t level = 0; valid && level <= top_level; ++level) {
+        Node* pred = preds[level];
+        if (level == 0 || pred != preds[level - 1]) {
+          pred->lock();
+        }
+        locked_level = level;
+        valid = !pred->marked.load(std::memory_order_acquire) &&
+                pred->next[level].load(std::memory_order_acquire) == victim;
+      }
+      if (!valid) {
+        unlock(preds, locked_level);
+        backoff();
+        continue;
+      }
+      for (ssize_t level = top_level; level >= 0; --level) {
+        preds[level]->next[level].store(
+            victim->next[level].load(std::memory_order_relaxed),
+            std::memory_order_release);
+      }
+      victim->unlock();
+      unlock(preds, locked_level);
+      // Unreachable now; threads that are still looking at it are pinned.
+      reclaimer.retire(
+          victim, [](void* ptr) { Node::destroy(static_cast<Node*>(ptr)); });
+      return true;
+    }
+  }
+
+  bool contains(const T& val) {
+    auto guard = reclaimer.pin();
+    Node* preds[max_level + 1];
+    Node* succs[max_level + 1];
+    ssize_t found_level = find(val, preds, succs, 0);
+    return found_level != -1 &&
+           succs[found_level]->fully_linked.load(std::memory_order_acquire) &&
+           !succs[found_level]->marked.load(std::memory_order_acquire);
+  }
+
+ private:
+  // Node class
+  // Towers are allocated inline like in LockFreeSkiplist; head and tail carry
+  // no key.
+  class Node {
+   public:
+    union {
+      T val;
+    };
+    int32_t top_level;
+    std::atomic<bool> locked = {false};
+    std::atomic<bool> marked = {false};
+    std::atomic<bool> fully_linked = {false};
+    std::atomic<Node*> next[1];
+
+    static Node* create(const T& val, ssize_t height) {
+      Node* node = create_sentinel(height);
+      new (&node->val) T(val);
+      return node;
+    }
+    static Node* create_sentinel(ssize_t height) {
+      void* raw = Allocator::allocate(size_for(height));
+      Node* node = new (raw) Node(height);
+      for (ssize_t i = 1; i <= height; ++i) {
+        new (&node->next[i]) std::atomic<Node*>(nullptr);
+      }
+      return node;
+    }
+    static void destroy(Node* node) {
+      node->val.~T();
+      destroy_sentinel(node);
+    }
+    static void destroy_sentinel(Node* node) {
+      const size_t size = size_for(node->top_level);
+      node->~Node();
+      Allocator::deallocate(node, size);
+    }
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
+    void lock() {
+      BackoffPolicy backoff;
+      while (locked.exchange(true, std::memory_order_acquire)) {
+        while (locked.load(std::memory_order_relaxed)) {
+          backoff();
+        }
+      }
+    }
+    void unlock() { locked.store(false, std::memory_order_release); }
+
+   private:
+    explicit Node(ssize_t height) : top_level(height), next{nullptr} {}
+    ~Node() {}
+    static size_t size_for(ssize_t height) {
+      return sizeof(Node) + height * sizeof(std::atomic<Node*>);
+    }
+  };
+  // end
+
+  Reclaimer reclaimer;
+  // Highest level any node has been linked at. Only ever grows.
+  alignas(padded_alignment<std::atomic<ssize_t>>) std::atomic<ssize_t> height;
+  Compare comp;
+  Node* const head;
+  Node* const tail;
+
+  // Whether `node` sorts before `val`; tail sorts after every key.
+  bool before(Node* node, const T& val) {
+    return node != tail && comp(node->val, val);
+  }
+
+  void raise_height(ssize_t level) {
+    ssize_t curr = height.load(std::memory_order_relaxed);
+    while (curr < level &&
+           !height.compare_exchange_weak(curr, level,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+    }
+  }
+
+  // Unlocks the predecessors locked on levels up to `locked_level`, each of
+  // them once.
+  void unlock(Node** preds, ssize_t locked_level) {
+    for (ssize_t level = 0; level <= locked_level; ++level) {
+      if (level == 0 || preds[level] != preds[level - 1]) {
+        preds[level]->unlock();
+      }
+    }
+  }
+
+  // Same generator as LockFreeSkiplist::random_level().
+  ssize_t random_level() {
+    static thread_local uint64_t state =
+        (uint64_t(std::random_device()()) << 32) | std::random_device()() | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return std::min<ssize_t>(__builtin_ctzll(state), max_level);
+  }
+
+  // Fills preds and succs on every level a node can currently have, and at
+  // least up to `min_level`, and returns the highest level `val` was found
+  // on, or -1. Takes no locks and never restarts.
+  ssize_t find(const T& val, Node** preds, Node** succs, ssize_t min_level) {
+    ssize_t found_level = -1;
+    Node* pred = head;
+    ssize_t start_level =
+        std::max(height.load(std::memory_order_acquire), min_level);
+    for (ssize_t level = start_level; level >= 0; --level) {
+      Node* curr = pred->next[level].load(std::memory_order_acquire);
+      while (before(curr, val)) {
+        pred = curr;
+        curr = pred->next[level].load(std::memory_order_acquire);
+      }
+      if (found_level == -1 && curr != tail && !comp(val, curr->val)) {
+        found_level = level;
+      }
+      preds[level] = pred;
+      succs[level] = curr;
+    }
+    return found_level;
+  }
+};
+
+#endif  // MY_LAZY_SKIPLIST
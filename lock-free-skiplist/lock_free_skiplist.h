@@ -1,50 +1,117 @@
 #ifndef MY_LOCKFREE_SKIPLIST
 #define MY_LOCKFREE_SKIPLIST
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <iostream>
-#include <limits>
-#include <mutex>
+#include <iterator>
+#include <new>
+#include <optional>
 #include <random>
-#include <stack>
-#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-template <typename T>
-class LockFreeSkiplist {
+#include "../common/backoff.h"
+#include "../common/cache_line.h"
+#include "../common/reclamation.h"
+#include "../common/slab_allocator.h"
+#include "../common/stats.h"
+
+template <typename T, ssize_t MaxLevel, typename Compare, typename BackoffPolicy,
+          typename Allocator, typename Reclaimer>
+class LockFreeSkiplist;
+
+// An ordered map from K to V. Keys are ordered by `Compare` and never need a
+// smallest or largest value: head and tail are sentinels told apart by their
+// address, and carry no key at all.
+//
+// Values that fit in a word are stored in the node and read and written with
+// single atomic operations; only those support update(). Larger values live
+// in a separate heap box that insert_or_assign() swaps out as a whole.
+//
+// The tuning knobs are template parameters, fixed at compile time:
+//  - MaxLevel: towers are at most MaxLevel + 1 high, which also sizes the
+//    search buffers kept on the stack;
+//  - BackoffPolicy: what a thread does after losing a CAS race, see
+//    common/backoff.h;
+//  - Allocator: where nodes come from, slab_allocator or anything with the
+//    same static allocate(size)/deallocate(p, size).
+//
+// Searches start at the highest level any node has reached so far rather than
+// at MaxLevel. A Finger additionally lets a thread resume from where its
+// previous operation ended, which makes runs of nearby or increasing keys
+// cost O(1) instead of O(log n).
+//
+// Removed nodes and replaced value boxes are handed to `Reclaimer` (see
+// common/reclamation.h), which frees them once no concurrent traversal can
+// still reach them. Traversals only pin(), so the reclaimer has to protect
+// whatever a pinned thread reaches: epoch_reclaimer or deferred_reclaimer,
+// not hazard_pointer_reclaimer. It is built for as many threads using the map
+// at once as the reclaimer_capacity passed in; any more wait for one of them
+// to exit.
+template <typename K, typename V, typename Compare = std::less<K>,
+          ssize_t MaxLevel = 32, typename BackoffPolicy = exp_yield_backoff<>,
+          typename Allocator = slab_allocator,
+          typename Reclaimer = epoch_reclaimer>
+class LockFreeSkipMap {
  private:
-  template <typename U>
+  template <typename T, ssize_t L, typename C, typename B, typename A,
+            typename R>
+  friend class LockFreeSkiplist;
   class Node;
   template <typename U>
   class MemoryManager;
-  template <size_t init_time, size_t multiplier>
-  class ExpBackoff;
+  using guard_t = decltype(std::declval<Reclaimer&>().pin());
+  static_assert(Reclaimer::protects_whole_operation,
+                "the skiplist never calls protect(), the reclaimer must keep "
+                "nodes alive for as long as a thread is pinned");
+  static constexpr ssize_t max_level = MaxLevel;
+  static constexpr bool value_in_place =
+      std::is_trivially_copyable<V>::value && sizeof(V) <= sizeof(uintptr_t);
 
  public:
-  LockFreeSkiplist(ssize_t max_level)
-      : max_level(max_level),
-        head(memory_manager.alloc(std::numeric_limits<T>::min(), max_level,
-                                  max_level)),
-        tail(memory_manager.alloc(std::numeric_limits<T>::max(), max_level,
-                                  max_level)) {
+  explicit LockFreeSkipMap(const Compare& comp = Compare())
+      : LockFreeSkipMap(reclaimer_capacity(), comp) {}
+  explicit LockFreeSkipMap(reclaimer_capacity capacity,
+                           const Compare& comp = Compare())
+      : memory_manager(capacity.threads),
+        height(0),
+        comp(comp),
+        head(memory_manager.alloc_sentinel(max_level)),
+        tail(memory_manager.alloc_sentinel(max_level)) {
     for (ssize_t i = 0; i <= max_level; ++i) {
-      head->next[i].store(MarkablePointer<Node<T>>(tail));
+      head->next[i].store(MarkablePointer<Node>(tail));
     }
   }
-  ~LockFreeSkiplist() {
-    Node<T>* cur = head;
-    while (cur) {
-      Node<T>* next = cur->next[0].load().getPtr();
-      delete cur;
+  ~LockFreeSkipMap() {
+    Node* cur = head->next[0].load().getPtr();
+    while (cur != tail) {
+      Node* next = cur->next[0].load().getPtr();
+      memory_manager.dealloc(cur);
       cur = next;
     }
+    memory_manager.dealloc_sentinel(head);
+    memory_manager.dealloc_sentinel(tail);
   }
 
   void print_nexts() {
-    Node<T>* curr = head;
+    auto guard = memory_manager.pin();
+    Node* curr = head;
     while (curr) {
-      std::cout << curr << ' ' << curr->val << ' ';
-      for (ssize_t i = 0; i <= max_level; ++i) {
+      std::cout << curr << ' ';
+      if (curr == head) {
+        std::cout << "head ";
+      } else if (curr == tail) {
+        std::cout << "tail ";
+      } else {
+        std::cout << curr->key << ' ';
+      }
+      for (ssize_t i = 0; i <= curr->top_level; ++i) {
         std::cout << curr->next[i].load().getPtr() << ' ';
       }
       std::cout << '\n';
@@ -52,42 +119,417 @@ class LockFreeSkiplist {
     }
   }
 
-  bool add(const T& val) {
+  // Per-thread search hint. It remembers where on every level the owning
+  // thread's last operation ended, and the next operation climbs up from
+  // there only as far as it needs to instead of descending from head.
+  //
+  // A finger holds no pin between operations, so an idle thread does not
+  // hold back reclamation. It notes the epoch its thread was pinned in when
+  // it remembered the nodes, and forgets them if the next operation is pinned
+  // in a later one: they may have been freed in between. Never share a
+  // finger between threads, and do not let it outlive the map.
+  class Finger {
+   public:
+    Finger(Finger&& other) = default;
+
+   private:
+    friend class LockFreeSkipMap;
+
+    explicit Finger(LockFreeSkipMap* list) : list(list) { preds.fill(nullptr); }
+    // Called pinned, before the operation looks at `preds`.
+    void enter() {
+      const uint64_t now = list->memory_manager.pinned_epoch();
+      if (now != epoch) {
+        preds.fill(nullptr);
+        epoch = now;
+      }
+    }
+    void remember(ssize_t level, Node* pred) {
+      preds[level] = pred == list->head ? nullptr : pred;
+    }
+
+    LockFreeSkipMap* list;
+    std::array<Node*, max_level + 1> preds;
+    uint64_t epoch = 0;
+  };
+
+  Finger finger() { return Finger(this); }
+
+  // Adds `key` unless it is already there. Returns whether it was added.
+  bool insert(const K& key, const V& value) {
+    return emplace(key, value, false, nullptr);
+  }
+  bool insert(Finger& finger, const K& key, const V& value) {
+    return emplace(key, value, false, &finger);
+  }
+
+  // Adds `key`, or replaces its value if it is already there. Returns whether
+  // it was added.
+  bool insert_or_assign(const K& key, const V& value) {
+    return emplace(key, value, true, nullptr);
+  }
+  bool insert_or_assign(Finger& finger, const K& key, const V& value) {
+    return emplace(key, value, true, &finger);
+  }
+
+  bool remove(const K& key) { return erase(key, nullptr); }
+  bool remove(Finger& finger, const K& key) { return erase(key, &finger); }
+
+  bool contains(const K& key) {
+    auto guard = memory_manager.pin();
+    return matches(lower_bound_node(key, nullptr), key);
+  }
+  bool contains(Finger& finger, const K& key) {
+    auto guard = memory_manager.pin();
+    finger.enter();
+    return matches(lower_bound_node(key, &finger), key);
+  }
+
+  std::optional<V> get(const K& key) {
+    auto guard = memory_manager.pin();
+    return get_from(lower_bound_node(key, nullptr), key);
+  }
+  std::optional<V> get(Finger& finger, const K& key) {
+    auto guard = memory_manager.pin();
+    finger.enter();
+    return get_from(lower_bound_node(key, &finger), key);
+  }
+
+  // Replaces the value of `key` with `fn(old value)` in a single atomic step.
+  // `fn` may run several times under contention and must not have side
+  // effects. Returns false, without calling `fn`, if `key` is not there.
+  template <typename Fn>
+  bool update(const K& key, Fn&& fn) {
+    static_assert(value_in_place,
+                  "update() needs a trivially copyable value that fits in a "
+                  "word");
+    auto guard = memory_manager.pin();
+    Node* node = lower_bound_node(key, nullptr);
+    if (!matches(node, key)) {
+      return false;
+    }
+    V old = node->value.load(std::memory_order_acquire);
+    while (!node->value.compare_exchange_weak(old, fn(old),
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+    }
+    return true;
+  }
+
+  // Builds the map from key-value pairs sorted by key, linking every level in
+  // one pass without any CAS; of equal keys the first one wins. The levels
+  // are published only once fully built, so concurrent readers see nothing
+  // until then, but there must be no concurrent updates. A map that is not
+  // empty falls back to insert_batch().
+  template <typename InputIt>
+  void bulk_load(InputIt first, InputIt last) {
+    load_sorted(first, last, [](const auto& e) -> const K& { return e.first; },
+                [](const auto& e) -> const V& { return e.second; });
+  }
+
+  // Inserts key-value pairs into a live map, in key order, so that each
+  // search resumes where the previous one ended. Keys already there keep
+  // their values. Returns how many keys were added.
+  template <typename InputIt>
+  size_t insert_batch(InputIt first, InputIt last) {
+    std::vector<std::pair<K, V>> entries(first, last);
+    std::stable_sort(entries.begin(), entries.end(),
+                     [this](const auto& a, const auto& b) {
+                       return comp(a.first, b.first);
+                     });
+    return insert_sorted(entries.begin(), entries.end(),
+                         [](const auto& e) -> const K& { return e.first; },
+                         [](const auto& e) -> const V& { return e.second; });
+  }
+
+  // Forward iterator over the entries in key order; `*it` is the key and
+  // `it.value()` reads the current value. Iteration is wait-free and weakly
+  // consistent: every key present for the whole iteration is visited, keys
+  // added or removed meanwhile may or may not be, and no key is visited
+  // twice. An iterator keeps the calling thread pinned in the reclaimer, so
+  // nodes removed meanwhile are not freed until it is destroyed; do not keep
+  // one around for long, and do not hand it to another thread.
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = K;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const K*;
+    using reference = const K&;
+
+    reference operator*() const { return curr->key; }
+    pointer operator->() const { return &curr->key; }
+    V value() const { return LockFreeSkipMap::load_value(curr); }
+    const_iterator& operator++() {
+      curr = LockFreeSkipMap::next_alive(curr);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const const_iterator& other) const {
+      return curr == other.curr;
+    }
+    bool operator!=(const const_iterator& other) const {
+      return curr != other.curr;
+    }
+
+   private:
+    friend class LockFreeSkipMap;
+    const_iterator(LockFreeSkipMap* list, Node* curr)
+        : list(list), curr(curr) {
+      if (list) {
+        guard.emplace(list->memory_manager.pin());
+      }
+    }
+
+   public:
+    // A copy takes its own pin, so it stays valid after the original is gone.
+    const_iterator(const const_iterator& other)
+        : const_iterator(other.list, other.curr) {}
+    const_iterator(const_iterator&& other) = default;
+    const_iterator& operator=(const_iterator other) {
+      list = other.list;
+      curr = other.curr;
+      guard.reset();
+      guard = std::move(other.guard);
+      return *this;
+    }
+
+   private:
+    LockFreeSkipMap* list;
+    Node* curr;
+    std::optional<guard_t> guard;
+  };
+
+  // Pin before reading the first node, so it cannot be freed in between.
+  const_iterator begin() {
+    const_iterator it(this, head);
+    it.curr = next_alive(head);
+    return it;
+  }
+  const_iterator end() { return const_iterator(nullptr, tail); }
+  // First key not less than `key`.
+  const_iterator lower_bound(const K& key) {
+    const_iterator it(this, head);
+    it.curr = lower_bound_node(key, nullptr);
+    return it;
+  }
+
+  // Calls `fn(key, value)` for every key in [lo, hi), in key order, with the
+  // same guarantees as iteration.
+  template <typename Fn>
+  void for_each_in_range(const K& lo, const K& hi, Fn&& fn) {
+    auto guard = memory_manager.pin();
+    for (Node* curr = lower_bound_node(lo, nullptr); before(curr, hi);
+         curr = next_alive(curr)) {
+      fn(curr->key, load_value(curr));
+    }
+  }
+
+ private:
+  // Keep the reclaimer's shared state away from the fields below, which are
+  // read by every traversal.
+  alignas(padded_alignment<MemoryManager<Node>>) MemoryManager<Node> memory_manager;
+  // Highest level any node has been linked at. Only ever grows.
+  alignas(padded_alignment<std::atomic<ssize_t>>) std::atomic<ssize_t> height;
+  Compare comp;
+  Node* const head;
+  Node* const tail;
+  // MarkablePointer class
+  template <typename U>
+  class MarkablePointer {
+   public:
+    MarkablePointer(U* ptr = NULL, bool mark = false) {
+      val = ((uintptr_t)ptr & ~mask) | (mark ? 1 : 0);
+    }
+    U* getPtr() { return (U*)(val & ~mask); }
+    bool getMark() { return val & mask; }
+
+   private:
+    uintptr_t val;
+    static const uintptr_t mask = 1;
+  };
+  template <typename U>
+  using AtomicMarkablePointer = std::atomic<MarkablePointer<U>>;
+  // end
+
+  // Node class
+  // The tower of next pointers is allocated inline, right behind the node,
+  // and only as high as the node itself: the key and next[0] share the first
+  // cache line and a typical node of height 1 or 2 takes a few dozen bytes.
+  // head and tail are built without a key. Nodes are created and destroyed
+  // only through create() and destroy(), sentinels through their own pair.
+  class Node {
+   public:
+    union {
+      K key;
+    };
+    std::conditional_t<value_in_place, std::atomic<V>, std::atomic<V*>> value;
+    int32_t top_level;
+    // Set once by the remover and once by the inserter, see unlinked_by().
+    std::atomic<int32_t> unlink_votes = {0};
+    AtomicMarkablePointer<Node> next[1];
+
+    static Node* create(const K& key, const V& value, ssize_t height) {
+      Node* node = create_sentinel(height);
+      new (&node->key) K(key);
+      if constexpr (value_in_place) {
+        node->value.store(value, std::memory_order_relaxed);
+      } else {
+        node->value.store(new V(value), std::memory_order_relaxed);
+      }
+      return node;
+    }
+    static Node* create_sentinel(ssize_t height) {
+      void* raw = Allocator::allocate(size_for(height));
+      Node* node = new (raw) Node(height);
+      for (ssize_t i = 1; i <= height; ++i) {
+        new (&node->next[i])
+            AtomicMarkablePointer<Node>(MarkablePointer<Node>());
+      }
+      return node;
+    }
+    static void destroy(Node* node) {
+      node->key.~K();
+      destroy_sentinel(node);
+    }
+    static void destroy_sentinel(Node* node) {
+      const size_t size = size_for(node->top_level);
+      if constexpr (!value_in_place) {
+        delete node->value.load(std::memory_order_relaxed);
+      }
+      node->~Node();
+      Allocator::deallocate(node, size);
+    }
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
+   private:
+    explicit Node(ssize_t height)
+        : value(), top_level(height), next{MarkablePointer<Node>()} {}
+    ~Node() {}
+    static size_t size_for(ssize_t height) {
+      return sizeof(Node) + height * sizeof(AtomicMarkablePointer<Node>);
+    }
+  };
+  // end
+
+  // MemoryManager class
+  // Nodes come from Allocator; removed ones go through Reclaimer.
+  template <typename U>
+  class MemoryManager {
+   public:
+    explicit MemoryManager(size_t max_threads) : reclaimer(max_threads) {}
+    template <typename... Args>
+    U* alloc(Args&&... args) {
+      return U::create(std::forward<Args>(args)...);
+    }
+    U* alloc_sentinel(ssize_t height) { return U::create_sentinel(height); }
+    void dealloc(U* p) { U::destroy(p); }
+    void dealloc_sentinel(U* p) { U::destroy_sentinel(p); }
+    auto pin() { return reclaimer.pin(); }
+    uint64_t pinned_epoch() { return reclaimer.pinned_epoch(); }
+    void retire(U* p) {
+      reclaimer.retire(p, [](void* ptr) { U::destroy(static_cast<U*>(ptr)); });
+    }
+    template <typename P>
+    void retire_object(P* p) {
+      reclaimer.retire(p, [](void* ptr) { delete static_cast<P*>(ptr); });
+    }
+
+   private:
+    Reclaimer reclaimer;
+  };
+  // end
+
+  // Whether `node` sorts before `key`; tail sorts after every key.
+  bool before(Node* node, const K& key) {
+    return node != tail && comp(node->key, key);
+  }
+  // Whether `node`, known not to sort before `key`, holds it.
+  bool matches(Node* node, const K& key) {
+    return node != tail && !comp(key, node->key);
+  }
+
+  static V load_value(Node* node) {
+    if constexpr (value_in_place) {
+      return node->value.load(std::memory_order_acquire);
+    } else {
+      return *node->value.load(std::memory_order_acquire);
+    }
+  }
+
+  void store_value(Node* node, const V& value) {
+    if constexpr (value_in_place) {
+      node->value.store(value, std::memory_order_release);
+    } else {
+      memory_manager.retire_object(
+          node->value.exchange(new V(value), std::memory_order_acq_rel));
+    }
+  }
+
+  std::optional<V> get_from(Node* node, const K& key) {
+    if (!matches(node, key)) {
+      return std::nullopt;
+    }
+    return load_value(node);
+  }
+
+  // Raises height to at least `level`. Done before linking a node that high,
+  // so whoever can reach the node also sees the new height.
+  void raise_height(ssize_t level) {
+    ssize_t curr = height.load(std::memory_order_relaxed);
+    while (curr < level &&
+           !height.compare_exchange_weak(curr, level,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+    }
+  }
+
+  bool emplace(const K& key, const V& value, bool assign, Finger* finger) {
+    auto guard = memory_manager.pin();
+    if (finger) {
+      finger->enter();
+    }
     ssize_t top_level = random_level();
+    raise_height(top_level);
     ssize_t bottom_level = 0;
-    Node<T>** preds = new Node<T>*[max_level + 1];
-    Node<T>** succs = new Node<T>*[max_level + 1];
-    ExpBackoff<1, 2> backoff;
+    Node* preds[max_level + 1];
+    Node* succs[max_level + 1];
+    BackoffPolicy backoff;
     while (true) {
-      if (find(val, preds, succs)) {
-        delete[] preds;
-        delete[] succs;
+      if (find(key, preds, succs, finger, top_level)) {
+        // If the node is being removed concurrently, the assignment takes
+        // effect just before the removal.
+        if (assign) {
+          store_value(succs[bottom_level], value);
+        }
         return false;
       } else {
         // std::cout << '\n';
         // print_nexts();
         // std::cout << '\n';
-        // Node<T>* new_node = memory_manager.alloc(max_level);
-        // new_node->setVal(val);
-        // new_node->setHeight(top_level);
-        Node<T>* new_node = new Node<T>(val, top_level, max_level);
+        Node* new_node = memory_manager.alloc(key, value, top_level);
         // std::cout << '\n';
         // print_nexts();
         // std::cout << '\n';
-        // if (val == 3) {
-        //   return true;
-        // }
         for (ssize_t level = bottom_level; level <= top_level; ++level) {
-          Node<T>* succ = succs[level];
-          new_node->next[level].store(MarkablePointer<Node<T>>(succ));
+          Node* succ = succs[level];
+          new_node->next[level].store(MarkablePointer<Node>(succ));
           // std::cout << new_node->next[level].load().getPtr() << ' ';
         }
-        Node<T>* pred = preds[bottom_level];
-        Node<T>* succ = succs[bottom_level];
-        new_node->next[bottom_level].store(MarkablePointer<Node<T>>(succ));
-        MarkablePointer<Node<T>> markable_succ(succ);
+        Node* pred = preds[bottom_level];
+        Node* succ = succs[bottom_level];
+        new_node->next[bottom_level].store(MarkablePointer<Node>(succ));
+        MarkablePointer<Node> markable_succ(succ);
         if (!pred->next[bottom_level].compare_exchange_strong(
-                markable_succ, MarkablePointer<Node<T>>(new_node))) {
+                markable_succ, MarkablePointer<Node>(new_node))) {
+          // Never published, nobody else can have seen it.
+          lockfree_stats::add(stat_counter::skiplist_add_cas_failures);
+          memory_manager.dealloc(new_node);
           backoff();  // ok
           continue;
         }
@@ -95,226 +537,290 @@ class LockFreeSkiplist {
           while (true) {
             pred = preds[level];
             succ = succs[level];
-            MarkablePointer<Node<T>> markable_succ(succ);
+            MarkablePointer<Node> own_succ = new_node->next[level].load();
+            if (own_succ.getMark()) {
+              // Removed while we were still linking, stop here.
+              goto linked;
+            }
+            if (own_succ.getPtr() != succ) {
+              new_node->next[level].compare_exchange_strong(
+                  own_succ, MarkablePointer<Node>(succ));
+              continue;
+            }
+            MarkablePointer<Node> markable_succ(succ);
             if (pred->next[level].compare_exchange_strong(
-                    markable_succ, MarkablePointer<Node<T>>(new_node))) {
+                    markable_succ, MarkablePointer<Node>(new_node))) {
               break;
             }
-            find(val, preds, succs);
+            lockfree_stats::add(stat_counter::skiplist_add_cas_failures);
+            find(key, preds, succs, finger, top_level);
+          }
+        }
+      linked:
+        // A remover may have marked the node and cleaned up before we linked
+        // the upper levels. Clean up again, then let whoever of the two is
+        // last hand the node to the reclaimer.
+        if (new_node->next[bottom_level].load().getMark()) {
+          find(key, preds, succs, finger, top_level);
+        } else if (finger) {
+          // The next key is likely to follow this one.
+          for (ssize_t level = bottom_level; level <= top_level; ++level) {
+            finger->remember(level, new_node);
           }
         }
-        delete[] preds;
-        delete[] succs;
+        unlinked_by(new_node);
         return true;
       }
     }
   }
 
-  bool remove(const T& val) {
+  bool erase(const K& key, Finger* finger) {
+    auto guard = memory_manager.pin();
+    if (finger) {
+      finger->enter();
+    }
     ssize_t bottom_level = 0;
-    Node<T>** preds = new Node<T>*[max_level + 1];
-    Node<T>** succs = new Node<T>*[max_level + 1];
-    MarkablePointer<Node<T>> succ;
-    ExpBackoff<1, 2> backoff;
+    Node* preds[max_level + 1];
+    Node* succs[max_level + 1];
+    MarkablePointer<Node> succ;
+    BackoffPolicy backoff;
     while (true) {
-      if (!find(val, preds, succs)) {
-        delete[] preds;
-        delete[] succs;
+      if (!find(key, preds, succs, finger, 0)) {
         return false;
       } else {
-        Node<T>* node_to_remove = succs[bottom_level];
+        Node* node_to_remove = succs[bottom_level];
         for (ssize_t level = node_to_remove->top_level;
              level >= bottom_level + 1; --level) {
           succ = node_to_remove->next[level].load();
-          bool flag = false;
           while (!succ.getMark()) {
-            // if (flag) {
-            //   backoff();
-            // }
-            node_to_remove->next[level].compare_exchange_strong(
-                succ, MarkablePointer<Node<T>>(succ.getPtr(), true));
-            flag = true;
+            if (node_to_remove->next[level].compare_exchange_strong(
+                    succ, MarkablePointer<Node>(succ.getPtr(), true))) {
+              break;
+            }
+            // Lost to an insert right after the node; give it time to finish.
+            lockfree_stats::add(stat_counter::skiplist_remove_cas_failures);
+            backoff();
           }
         }
         succ = node_to_remove->next[bottom_level].load();
         while (true) {
-          MarkablePointer<Node<T>> succ_buf = succ.getPtr();
+          MarkablePointer<Node> succ_buf = succ.getPtr();
           bool i_marked_it =
               node_to_remove->next[bottom_level].compare_exchange_strong(
-                  succ_buf, MarkablePointer<Node<T>>(succ.getPtr(), true));
+                  succ_buf, MarkablePointer<Node>(succ.getPtr(), true));
           succ = succs[bottom_level]->next[bottom_level].load();
           if (i_marked_it) {
-            find(val, preds, succs);
-            delete[] preds;
-            delete[] succs;
-            memory_manager.retire(node_to_remove);
+            find(key, preds, succs, finger, node_to_remove->top_level);
+            unlinked_by(node_to_remove);
             return true;
           } else if (succ.getMark()) {
-            delete[] preds;
-            delete[] succs;
             return false;
           }
+          lockfree_stats::add(stat_counter::skiplist_remove_cas_failures);
+          backoff();
         }
       }
     }
   }
 
-  bool contains(const T& val) {
+  template <typename InputIt, typename KeyOf, typename ValueOf>
+  void load_sorted(InputIt first, InputIt last, KeyOf key_of,
+                   ValueOf value_of) {
+    if (head->next[0].load().getPtr() != tail) {
+      std::vector<std::pair<K, V>> entries;
+      for (; first != last; ++first) {
+        entries.emplace_back(key_of(*first), value_of(*first));
+      }
+      insert_batch(entries.begin(), entries.end());
+      return;
+    }
+    // Entries out of order are inserted the usual way afterwards.
+    std::vector<std::pair<K, V>> stragglers;
+    std::array<Node*, max_level + 1> firsts;
+    std::array<Node*, max_level + 1> lasts;
+    firsts.fill(tail);
+    lasts.fill(nullptr);
+    ssize_t top_level = 0;
+    for (; first != last; ++first) {
+      auto&& entry = *first;
+      const K& key = key_of(entry);
+      if (lasts[0] && !comp(lasts[0]->key, key)) {
+        if (comp(key, lasts[0]->key)) {
+          stragglers.emplace_back(key, value_of(entry));
+        }
+        continue;
+      }
+      ssize_t level = random_level();
+      Node* node = memory_manager.alloc(key, value_of(entry), level);
+      // Nobody is still linking it, see unlinked_by().
+      node->unlink_votes.store(1, std::memory_order_relaxed);
+      for (ssize_t i = 0; i <= level; ++i) {
+        node->next[i].store(MarkablePointer<Node>(tail),
+                            std::memory_order_relaxed);
+        if (lasts[i]) {
+          lasts[i]->next[i].store(MarkablePointer<Node>(node),
+                                  std::memory_order_relaxed);
+        } else {
+          firsts[i] = node;
+        }
+        lasts[i] = node;
+      }
+      top_level = std::max(top_level, level);
+    }
+    raise_height(top_level);
+    for (ssize_t level = 0; level <= top_level; ++level) {
+      head->next[level].store(MarkablePointer<Node>(firsts[level]),
+                              std::memory_order_release);
+    }
+    insert_batch(stragglers.begin(), stragglers.end());
+  }
+
+  template <typename InputIt, typename KeyOf, typename ValueOf>
+  size_t insert_sorted(InputIt first, InputIt last, KeyOf key_of,
+                       ValueOf value_of) {
+    Finger finger(this);
+    size_t added = 0;
+    for (; first != last; ++first) {
+      auto&& entry = *first;
+      added += emplace(key_of(entry), value_of(entry), false, &finger);
+    }
+    return added;
+  }
+
+  // Where to start looking for `key`: the level, at least `min_level`, and
+  // the node on it that `finger` suggests, or -1 to start from head. The
+  // search climbs from the bottom while the next hop on the current level
+  // still falls short of `key`, so that it can take the express lanes above.
+  ssize_t finger_start(Finger* finger, const K& key, ssize_t min_level,
+                       Node*& start) {
+    if (!finger) {
+      return -1;
+    }
+    const auto& preds = finger->preds;
+    auto usable = [&](ssize_t level) {
+      Node* node = preds[level];
+      return node && before(node, key) &&
+             !node->next[level].load().getMark();
+    };
+    if (!usable(0)) {
+      return -1;
+    }
+    ssize_t level = 0;
+    while (level < max_level &&
+           (level < min_level ||
+            before(preds[level]->next[level].load().getPtr(), key)) &&
+           usable(level + 1)) {
+      ++level;
+    }
+    if (level < min_level) {
+      return -1;
+    }
+    start = preds[level];
+    return level;
+  }
+
+  // First node on the bottom level that is not marked as removed and whose
+  // key is not less than `key`. Must be called pinned.
+  Node* lower_bound_node(const K& key, Finger* finger) {
     ssize_t bottom_level = 0;
-    Node<T>* pred = head;
-    Node<T>* curr;
-    MarkablePointer<Node<T>> succ;
-    ExpBackoff<1, 2> backoff;
-    for (ssize_t level = max_level; level >= bottom_level; --level) {
+    Node* pred = head;
+    ssize_t start_level = finger_start(finger, key, 0, pred);
+    if (start_level < 0) {
+      pred = head;
+      start_level = height.load(std::memory_order_acquire);
+    }
+    Node* curr = pred;
+    MarkablePointer<Node> succ;
+    for (ssize_t level = start_level; level >= bottom_level; --level) {
       curr = pred->next[level].load().getPtr();
       while (true) {
         succ = curr->next[level].load();
+        // Step over removed nodes instead of rereading pred: if pred itself
+        // has been removed, its next pointer never changes again.
         while (succ.getMark()) {
-          // backoff();
-          curr = pred->next[level].load().getPtr();
+          curr = succ.getPtr();
           succ = curr->next[level].load();
         }
-        if (curr->val < val) {
+        if (before(curr, key)) {
           pred = curr;
           curr = succ.getPtr();
         } else {
           break;
         }
       }
-    }
-    return (curr->val == val);
-  }
-
- private:
-  MemoryManager<Node<T>> memory_manager;
-  ssize_t max_level;
-  Node<T>* const head;
-  Node<T>* const tail;
-  // MarkablePointer class
-  template <typename U>
-  class MarkablePointer {
-   public:
-    MarkablePointer(U* ptr = NULL, bool mark = false) {
-      val = ((uintptr_t)ptr & ~mask) | (mark ? 1 : 0);
-    }
-    U* getPtr() { return (U*)(val & ~mask); }
-    bool getMark() { return val & mask; }
-
-   private:
-    uintptr_t val;
-    static const uintptr_t mask = 1;
-  };
-  template <typename U>
-  using AtomicMarkablePointer = std::atomic<MarkablePointer<U>>;
-  // end
-
-  // Node class
-  template <typename U>
-  class Node {
-   public:
-    AtomicMarkablePointer<Node<U>>* next;
-    U val;
-    ssize_t top_level;
-    Node(ssize_t max_level)
-        : next(new AtomicMarkablePointer<Node<U>>[max_level + 1]) {
-      for (ssize_t i = 0; i < max_level; ++i) {
-        next[i].store(MarkablePointer<Node<U>>());
+      if (finger) {
+        finger->remember(level, pred);
       }
     }
-    Node(const U& val, ssize_t height, ssize_t max_level) : Node(max_level) {
-      this->val = val;
-      this->top_level = height;
-    }
-    void setVal(const U& val) { this->val = val; }
-    void setHeight(const ssize_t& height) { this->top_level = height; }
-    ~Node() { delete[] next; }
-  };
-  // end
+    return curr;
+  }
 
-  // MemoryManager class
-  template <typename U>
-  class MemoryManager {
-   public:
-    template <typename... Args>
-    U* alloc(Args&&... args) {
-      std::lock_guard<std::mutex> guard(lock);
-      if (buf.empty()) {
-        buf.push(new U(std::forward<Args>(args)...));
-      } else {
-        *buf.top() = U(std::forward<Args>(args)...);
-      }
-      U* top = buf.top();
-      buf.pop();
-      return top;
-    }
-    void retire(U* p) {
-      std::lock_guard<std::mutex> guard(lock);
-      buf.push(p);
-    }
-    ~MemoryManager() {
-      while (!buf.empty()) {
-        delete buf.top();
-        buf.pop();
-      }
+  // Next node on the bottom level that is not marked as removed, or tail.
+  static Node* next_alive(Node* node) {
+    Node* curr = node->next[0].load().getPtr();
+    while (curr->next[0].load().getMark()) {
+      curr = curr->next[0].load().getPtr();
     }
+    return curr;
+  }
 
-   private:
-    std::stack<U*> buf;
-    std::mutex lock;
-  };
-  // end
-
-  // ExpBackoff class
-  template <size_t init_time, size_t multiplier>
-  class ExpBackoff {
-   public:
-    ExpBackoff() : cur_sleep_for(init_time) {}
-    void operator()() {
-      std::this_thread::sleep_for(std::chrono::nanoseconds(cur_sleep_for));
-      cur_sleep_for *= multiplier;
+  // A node may only be retired once it is unlinked on every level. Both the
+  // thread that inserted it and the one that removed it clean up after
+  // themselves, so the second of them to get here retires the node.
+  void unlinked_by(Node* node) {
+    if (node->unlink_votes.fetch_add(1, std::memory_order_acq_rel) == 1) {
+      memory_manager.retire(node);
     }
+  }
 
-   private:
-    size_t cur_sleep_for;
-  };
-  // end
-
+  // Each level is kept with probability 1/2, so the level is the number of
+  // trailing zero bits of a random word. The xorshift state is per thread:
+  // rand() takes a lock inside glibc and serializes concurrent inserts.
   ssize_t random_level() {
-    ssize_t level = 0;
-    while (level < max_level) {
-      if (rand() % 2) {
-        break;
-      }
-      ++level;
-    }
-    return level;
+    static thread_local uint64_t state =
+        (uint64_t(std::random_device()()) << 32) | std::random_device()() | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return std::min<ssize_t>(__builtin_ctzll(state), max_level);
   }
 
-  bool find(const T& val, Node<T>** preds, Node<T>** succs) {
+  // Fills preds and succs on every level a node can currently have, or, when
+  // `finger` is close enough to `key`, only up to some level no lower than
+  // `min_level`.
+  bool find(const K& key, Node** preds, Node** succs, Finger* finger,
+            ssize_t min_level) {
     ssize_t bottom_level = 0;
-    Node<T>* pred;
-    Node<T>* curr;
-    MarkablePointer<Node<T>> succ;
-    ExpBackoff<1, 2> backoff;
+    Node* pred = head;
+    Node* curr = nullptr;
+    MarkablePointer<Node> succ;
+    BackoffPolicy backoff;
+    Node* start = nullptr;
+    ssize_t start_level = finger_start(finger, key, min_level, start);
   retry:
     while (true) {
-      pred = head;
-      for (ssize_t level = max_level; level >= bottom_level; --level) {
+      pred = start_level < 0 ? head : start;
+      if (start_level < 0) {
+        start_level = height.load(std::memory_order_acquire);
+      }
+      for (ssize_t level = start_level; level >= bottom_level; --level) {
         curr = pred->next[level].load().getPtr();
         while (true) {
           succ = curr->next[level].load();
           while (succ.getMark()) {
-            MarkablePointer<Node<T>> markable_curr(curr);
+            MarkablePointer<Node> markable_curr(curr);
             if (!pred->next[level].compare_exchange_strong(
-                    markable_curr, MarkablePointer<Node<T>>(succ.getPtr()))) {
+                    markable_curr, MarkablePointer<Node>(succ.getPtr()))) {
               // std::cout << "goto\n";
+              lockfree_stats::add(stat_counter::skiplist_find_restarts);
               backoff();  // ok
+              start_level = -1;
               goto retry;
             }
             curr = pred->next[level].load().getPtr();
             succ = curr->next[level].load();
           }
-          if (curr->val < val) {
+          if (before(curr, key)) {
             pred = curr;
             curr = succ.getPtr();
           } else {
@@ -323,10 +829,83 @@ class LockFreeSkiplist {
         }
         preds[level] = pred;
         succs[level] = curr;
+        if (finger) {
+          finger->remember(level, pred);
+        }
       }
-      return curr->val == val;
+      return matches(curr, key);
     }
   }
 };
 
+// An ordered set: a LockFreeSkipMap without values.
+template <typename T, ssize_t MaxLevel = 32, typename Compare = std::less<T>,
+          typename BackoffPolicy = exp_yield_backoff<>,
+          typename Allocator = slab_allocator,
+          typename Reclaimer = epoch_reclaimer>
+class LockFreeSkiplist {
+ private:
+  struct Empty {};
+  using Map = LockFreeSkipMap<T, Empty, Compare, MaxLevel, BackoffPolicy,
+                              Allocator, Reclaimer>;
+
+ public:
+  using const_iterator = typename Map::const_iterator;
+  using Finger = typename Map::Finger;
+
+  explicit LockFreeSkiplist(const Compare& comp = Compare()) : map(comp) {}
+  explicit LockFreeSkiplist(reclaimer_capacity capacity,
+                            const Compare& comp = Compare())
+      : map(capacity, comp) {}
+
+  void print_nexts() { map.print_nexts(); }
+  bool add(const T& val) { return map.insert(val, Empty()); }
+  bool remove(const T& val) { return map.remove(val); }
+  bool contains(const T& val) { return map.contains(val); }
+
+  Finger finger() { return map.finger(); }
+  bool add(Finger& finger, const T& val) {
+    return map.insert(finger, val, Empty());
+  }
+  bool remove(Finger& finger, const T& val) {
+    return map.remove(finger, val);
+  }
+  bool contains(Finger& finger, const T& val) {
+    return map.contains(finger, val);
+  }
+
+  // See LockFreeSkipMap::bulk_load() and insert_batch().
+  template <typename InputIt>
+  void bulk_load(InputIt first, InputIt last) {
+    map.load_sorted(first, last, [](const T& val) -> const T& { return val; },
+                    [](const T&) { return Empty(); });
+  }
+  template <typename InputIt>
+  size_t insert_batch(InputIt first, InputIt last) {
+    std::vector<T> vals(first, last);
+    const Compare& comp = map.comp;
+    std::sort(vals.begin(), vals.end(), comp);
+    vals.erase(std::unique(vals.begin(), vals.end(),
+                           [&comp](const T& a, const T& b) {
+                             return !comp(a, b);
+                           }),
+               vals.end());
+    return map.insert_sorted(vals.begin(), vals.end(),
+                             [](const T& val) -> const T& { return val; },
+                             [](const T&) { return Empty(); });
+  }
+
+  const_iterator begin() { return map.begin(); }
+  const_iterator end() { return map.end(); }
+  const_iterator lower_bound(const T& val) { return map.lower_bound(val); }
+  template <typename Fn>
+  void for_each_in_range(const T& lo, const T& hi, Fn&& fn) {
+    map.for_each_in_range(lo, hi,
+                          [&fn](const T& val, Empty) { fn(val); });
+  }
+
+ private:
+  Map map;
+};
+
 #endif  // MY_LOCKFREE_SKIPLIST
\ No newline at end of file
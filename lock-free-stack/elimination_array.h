@@ -0,0 +1,162 @@
+#ifndef ELIMINATION_ARRAY_H
+#define ELIMINATION_ARRAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../common/cache_line.h"
+
+// Elimination array (Hendler, Shavit, Yerushalmi): a push and a pop that both
+// failed their CAS on the stack top meet in a randomly chosen slot and hand
+// the node over directly, as if the push happened right before the pop.
+//
+// A slot holds one of
+//   empty          - free,
+//   pop_waiting    - a pop waits for a node,
+//   node           - a push offers its node, any pop may take it,
+//   node | granted - a push answered a waiting pop, only that pop may take it,
+//   taken          - a pop took the offered node, the push clears the slot.
+//
+// Every thread tunes its own range of slots and its wait time: a partner found
+// means there is enough traffic to spread out and wait longer, a timeout means
+// the opposite.
+template <typename Node>
+class elimination_array {
+ public:
+  explicit elimination_array(size_t threads_num)
+      : slots_(std::max<size_t>(1, std::min<size_t>(threads_num / 2, 64))) {}
+
+  // True if the node went to a pop.
+  bool exchange_push(Node* node);
+  // A node handed over by a push or nullptr.
+  Node* exchange_pop();
+
+ private:
+  static constexpr uintptr_t empty = 0;
+  static constexpr uintptr_t granted = 1;
+  static constexpr uintptr_t taken = 2;
+  static constexpr uintptr_t pop_waiting = 4;
+  static constexpr size_t min_spins = 16;
+  static constexpr size_t max_spins = 1024;
+
+  struct tuning {
+    size_t range = 1;
+    size_t spins = min_spins;
+    uint64_t seed = 0;
+  };
+
+  std::vector<padded_atomic<uintptr_t>> slots_;
+
+  static bool is_node(uintptr_t v) { return v > pop_waiting; }
+  tuning& my_tuning();
+  padded_atomic<uintptr_t>& random_slot(tuning& t);
+  void on_success(tuning& t) {
+    t.range = std::min(t.range + 1, slots_.size());
+    t.spins = std::min(t.spins * 2, max_spins);
+  }
+  void on_timeout(tuning& t) {
+    t.range = std::max<size_t>(t.range / 2, 1);
+    t.spins = std::max(t.spins / 2, min_spins);
+  }
+  void on_collision(tuning& t) {
+    t.range = std::min(t.range * 2, slots_.size());
+  }
+};
+
+template <typename Node>
+typename elimination_array<Node>::tuning& elimination_array<Node>::my_tuning() {
+  thread_local tuning t;
+  if (!t.seed) {
+    t.seed = reinterpret_cast<uintptr_t>(&t) | 1;
+  }
+  t.range = std::min(t.range, slots_.size());
+  return t;
+}
+
+template <typename Node>
+padded_atomic<uintptr_t>& elimination_array<Node>::random_slot(tuning& t) {
+  t.seed ^= t.seed << 13;
+  t.seed ^= t.seed >> 7;
+  t.seed ^= t.seed << 17;
+  return slots_[t.seed % t.range];
+}
+
+template <typename Node>
+bool elimination_array<Node>::exchange_push(Node* node) {
+  tuning& t = my_tuning();
+  auto& slot = random_slot(t);
+  const auto mine = reinterpret_cast<uintptr_t>(node);
+  uintptr_t v = slot.load(std::memory_order_acquire);
+  if (v == pop_waiting) {
+    if (slot.compare_exchange_strong(v, mine | granted,
+                                     std::memory_order_acq_rel)) {
+      on_success(t);
+      return true;
+    }
+    on_collision(t);
+    return false;
+  }
+  if (v != empty ||
+      !slot.compare_exchange_strong(v, mine, std::memory_order_acq_rel)) {
+    on_collision(t);
+    return false;
+  }
+  for (size_t i = 0; i < t.spins; ++i) {
+    if (slot.load(std::memory_order_acquire) == taken) {
+      slot.store(empty, std::memory_order_release);
+      on_success(t);
+      return true;
+    }
+  }
+  v = mine;
+  if (slot.compare_exchange_strong(v, empty, std::memory_order_acq_rel)) {
+    on_timeout(t);
+    return false;
+  }
+  // The only way the offer could have changed is a pop taking it.
+  slot.store(empty, std::memory_order_release);
+  on_success(t);
+  return true;
+}
+
+template <typename Node>
+Node* elimination_array<Node>::exchange_pop() {
+  tuning& t = my_tuning();
+  auto& slot = random_slot(t);
+  uintptr_t v = slot.load(std::memory_order_acquire);
+  if (is_node(v) && !(v & granted)) {
+    if (slot.compare_exchange_strong(v, taken, std::memory_order_acq_rel)) {
+      on_success(t);
+      return reinterpret_cast<Node*>(v);
+    }
+    on_collision(t);
+    return nullptr;
+  }
+  if (v != empty ||
+      !slot.compare_exchange_strong(v, pop_waiting,
+                                    std::memory_order_acq_rel)) {
+    on_collision(t);
+    return nullptr;
+  }
+  for (size_t i = 0; i < t.spins; ++i) {
+    v = slot.load(std::memory_order_acquire);
+    if (v != pop_waiting) {
+      break;
+    }
+  }
+  if (v == pop_waiting) {
+    if (slot.compare_exchange_strong(v, empty, std::memory_order_acq_rel)) {
+      on_timeout(t);
+      return nullptr;
+    }
+  }
+  // Only a push can replace pop_waiting, and it does so with a granted node.
+  slot.store(empty, std::memory_order_release);
+  on_success(t);
+  return reinterpret_cast<Node*>(v & ~granted);
+}
+
+#endif  // ELIMINATION_ARRAY_H
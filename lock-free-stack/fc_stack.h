@@ -0,0 +1,117 @@
+#ifndef FC_STACK_H
+#define FC_STACK_H
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "../common/flat_combining.h"
+
+// Stack with the same interface as not_lockfree_stack, but serialized through
+// flat combining instead of a mutex per operation. Within a batch, pushes and
+// pops cancel each other out without touching the stack at all.
+template <typename T>
+class fc_stack {
+ public:
+  explicit fc_stack(int threads_num) : combiner_(threads_num) {}
+  void push(const T& val);
+  void push(T&& val);
+  // Returns T{} when the stack is empty, try_pop() tells that apart.
+  T pop();
+  bool try_pop(T& out);
+  std::optional<T> try_pop();
+
+ private:
+  struct request {
+    bool is_push;
+    T value;
+  };
+  using combiner_t = flat_combining<request, std::optional<T>>;
+  using record_t = typename combiner_t::record;
+
+  void combine(record_t** records, size_t n);
+
+  combiner_t combiner_;
+  // Only accessed by the current combiner.
+  std::vector<T> items_;
+};
+
+template <typename T>
+void fc_stack<T>::push(const T& val) {
+  combiner_.execute(request{true, val}, [this](record_t** records, size_t n) {
+    combine(records, n);
+  });
+}
+
+template <typename T>
+void fc_stack<T>::push(T&& val) {
+  combiner_.execute(
+      request{true, std::move(val)},
+      [this](record_t** records, size_t n) { combine(records, n); });
+}
+
+template <typename T>
+T fc_stack<T>::pop() {
+  std::optional<T> result = try_pop();
+  return result ? std::move(*result) : T{};
+}
+
+template <typename T>
+bool fc_stack<T>::try_pop(T& out) {
+  std::optional<T> result = try_pop();
+  if (!result) {
+    return false;
+  }
+  out = std::move(*result);
+  return true;
+}
+
+template <typename T>
+std::optional<T> fc_stack<T>::try_pop() {
+  return combiner_.execute(
+      request{false, T{}},
+      [this](record_t** records, size_t n) { combine(records, n); });
+}
+
+template <typename T>
+void fc_stack<T>::combine(record_t** records, size_t n) {
+  // Pair the k-th pending push with the k-th pending pop first: the pop gets
+  // the pushed value directly, which is a valid linearization since both
+  // operations are in flight at the same time.
+  size_t push_i = 0;
+  size_t pop_i = 0;
+  while (true) {
+    while (push_i < n && !records[push_i]->request.is_push) {
+      ++push_i;
+    }
+    while (pop_i < n && records[pop_i]->request.is_push) {
+      ++pop_i;
+    }
+    if (push_i == n || pop_i == n) {
+      break;
+    }
+    records[push_i]->response.reset();
+    records[pop_i++]->response = std::move(records[push_i++]->request.value);
+  }
+  // Whatever is left is either only pushes or only pops.
+  for (size_t i = push_i; i < n; ++i) {
+    if (records[i]->request.is_push) {
+      items_.push_back(std::move(records[i]->request.value));
+      records[i]->response.reset();
+    }
+  }
+  for (size_t i = pop_i; i < n; ++i) {
+    if (records[i]->request.is_push) {
+      continue;
+    }
+    if (items_.empty()) {
+      records[i]->response.reset();
+    } else {
+      records[i]->response = std::move(items_.back());
+      items_.pop_back();
+    }
+  }
+}
+
+#endif  // FC_STACK_H
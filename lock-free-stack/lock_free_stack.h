@@ -5,14 +5,21 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstddef>
 #include <iostream>
-#include <map>
-#include <mutex>
-#include <sstream>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "../common/cache_line.h"
+#include "../common/reclamation.h"
+#include "../common/slab_allocator.h"
+#include "../common/stats.h"
+#include "elimination_array.h"
+
 template <typename T>
 struct stack_node {
   T data;
@@ -20,131 +27,258 @@ struct stack_node {
 
   stack_node() : data{}, next(nullptr) {}
   explicit stack_node(const T& value) : data(value), next(nullptr) {}
+  explicit stack_node(T&& value) : data(std::move(value)), next(nullptr) {}
+
+  static void* operator new(size_t size) {
+    return slab_allocator::allocate(size);
+  }
+  static void operator delete(void* p, size_t size) {
+    slab_allocator::deallocate(p, size);
+  }
 };
 
-template <typename T>
+// Popped nodes are freed through `Reclaimer` (see common/reclamation.h):
+// hazard_pointer_reclaimer by default, epoch_reclaimer as the alternative.
+// Prefer try_pop(): it moves the value out and retires the node right away.
+// A node returned by pop() stays valid until the same thread pops again.
+template <typename T, typename Reclaimer = hazard_pointer_reclaimer>
 class lockfree_stack {
  public:
   void push(const T& val);
+  void push(T&& val);
+  // Links [first, last) into a private chain and publishes it with one CAS;
+  // the first element ends up deepest. Pass move iterators to move values in.
+  template <typename InputIt>
+  void push_range(InputIt first, InputIt last);
   stack_node<T>* pop();
+  bool try_pop(T& out);
+  std::optional<T> try_pop();
+  // Detaches up to `n` top elements with one CAS and moves their values to
+  // `out`, topmost first. Returns how many were popped.
+  template <typename OutputIt>
+  size_t pop_many(size_t n, OutputIt out);
   explicit lockfree_stack(size_t threads_num);
   ~lockfree_stack();
 
  private:
-  std::atomic<stack_node<T>*> top_;
-  std::map<std::thread::id, stack_node<T>*> hazard_ptrs_;
-  std::map<std::thread::id, std::vector<stack_node<T>*>> retired_;
+  // Every push and pop hits `top_`, keep it away from the bookkeeping below.
+  padded_atomic<stack_node<T>*> top_;
   size_t threads_num_;
+  Reclaimer reclaimer_;
+  // Last node popped by each thread, indexed by reclaimer slot.
+  std::unique_ptr<padded<stack_node<T>*>[]> popped_;
+  elimination_array<stack_node<T>> elimination_;
+  void push_node(stack_node<T>* new_node);
+  stack_node<T>* detach_top();
+  void push_chain(stack_node<T>* first, stack_node<T>* last);
   void retire(stack_node<T>* retired_ptr);
-  void scan();
-  void init_hazard_ptrs();
-  std::mutex hazard_init_mutex_;
 };
 
-template <typename T>
-void lockfree_stack<T>::push(const T& val) {
-  auto* new_node = new stack_node<T>(val);
-  // std::ostringstream os;
-  // os << std::this_thread::get_id() << " Push with addr " << new_node << "\n";
-  // std::cout << os.str();
+template <typename T, typename Reclaimer>
+void lockfree_stack<T, Reclaimer>::push(const T& val) {
+  push_node(new stack_node<T>(val));
+}
+
+template <typename T, typename Reclaimer>
+void lockfree_stack<T, Reclaimer>::push(T&& val) {
+  push_node(new stack_node<T>(std::move(val)));
+}
+
+template <typename T, typename Reclaimer>
+template <typename InputIt>
+void lockfree_stack<T, Reclaimer>::push_range(InputIt first, InputIt last) {
+  if (first == last) {
+    return;
+  }
+  // Build the chain bottom-up while nobody else can see it.
+  stack_node<T>* bottom = new stack_node<T>(*first);
+  stack_node<T>* top = bottom;
+  for (++first; first != last; ++first) {
+    auto* node = new stack_node<T>(*first);
+    node->next.store(top, std::memory_order_relaxed);
+    top = node;
+  }
+  push_chain(top, bottom);
+}
+
+template <typename T, typename Reclaimer>
+void lockfree_stack<T, Reclaimer>::push_chain(stack_node<T>* first,
+                                              stack_node<T>* last) {
+  stack_node<T>* top = top_.load(std::memory_order_relaxed);
+  while (true) {
+    last->next.store(top, std::memory_order_relaxed);
+    if (top_.compare_exchange_weak(top, first, std::memory_order_release)) {
+      return;
+    }
+    lockfree_stats::add(stat_counter::stack_push_cas_failures);
+    std::this_thread::yield();
+  }
+}
+
+template <typename T, typename Reclaimer>
+void lockfree_stack<T, Reclaimer>::push_node(stack_node<T>* new_node) {
   stack_node<T>* top = top_.load(std::memory_order_relaxed);
   while (true) {
     new_node->next.store(top, std::memory_order_relaxed);
     if (top_.compare_exchange_weak(top, new_node, std::memory_order_release)) {
       return;
     }
+    lockfree_stats::add(stat_counter::stack_push_cas_failures);
+#ifndef NO_ELIMINATION
+    if (elimination_.exchange_push(new_node)) {
+      lockfree_stats::add(stat_counter::stack_eliminations);
+      return;
+    }
+#else
     std::this_thread::yield();
+#endif
   }
 }
 
-template <typename T>
-stack_node<T>* lockfree_stack<T>::pop() {
-  init_hazard_ptrs();
-  const std::thread::id tid = std::this_thread::get_id();
-  retire(hazard_ptrs_[tid]);
-  // std::ostringstream os;
+template <typename T, typename Reclaimer>
+stack_node<T>* lockfree_stack<T, Reclaimer>::detach_top() {
   while (true) {
-    stack_node<T>* top = top_.load(std::memory_order_acquire);
-    hazard_ptrs_[tid] = top;
+    stack_node<T>* top = reclaimer_.protect(0, top_);
     if (!top) {
-      // os << tid << " Pop empty\n";
-      // std::cout << os.str();
       return nullptr;
     }
     stack_node<T>* next = top->next.load(std::memory_order_relaxed);
     if (top_.compare_exchange_weak(top, next, std::memory_order_acquire,
                                    std::memory_order_relaxed)) {
-      // os << tid << " Pop  with addr " << top << "\n";
-      // std::cout << os.str();
       return top;
     }
+    lockfree_stats::add(stat_counter::stack_pop_cas_failures);
+#ifndef NO_ELIMINATION
+    if (stack_node<T>* node = elimination_.exchange_pop()) {
+      lockfree_stats::add(stat_counter::stack_eliminations);
+      return node;
+    }
+#else
     std::this_thread::yield();
+#endif
   }
 }
 
-// 0: A -> C
-// 1: A -> B -> C
-
-template <typename T>
-lockfree_stack<T>::lockfree_stack(size_t threads_num)
-    : threads_num_(threads_num), top_(nullptr) {}
+template <typename T, typename Reclaimer>
+stack_node<T>* lockfree_stack<T, Reclaimer>::pop() {
+  auto guard = reclaimer_.pin();
+  stack_node<T>*& popped = popped_[reclaimer_.thread_slot()].value;
+  retire(popped);
+  popped = detach_top();
+  return popped;
+}
 
-template <typename T>
-lockfree_stack<T>::~lockfree_stack() {
-  for (auto it = hazard_ptrs_.begin(); it != hazard_ptrs_.end(); ++it) {
-    delete it->second;
-  }
-  for (auto it = retired_.begin(); it != retired_.end(); ++it) {
-    for (auto& retired : it->second) {
-      delete retired;
-    }
+template <typename T, typename Reclaimer>
+bool lockfree_stack<T, Reclaimer>::try_pop(T& out) {
+  auto guard = reclaimer_.pin();
+  stack_node<T>* node = detach_top();
+  if (!node) {
+    return false;
   }
+  out = std::move(node->data);
+  retire(node);
+  return true;
 }
 
-template <typename T>
-void lockfree_stack<T>::init_hazard_ptrs() {
-  std::thread::id tid = std::this_thread::get_id();
-  std::lock_guard<std::mutex> guard(hazard_init_mutex_);
-  if (hazard_ptrs_.find(tid) == hazard_ptrs_.end()) {
-    hazard_ptrs_[tid] = nullptr;
-    retired_[tid] = std::vector<stack_node<T>*>();
+template <typename T, typename Reclaimer>
+std::optional<T> lockfree_stack<T, Reclaimer>::try_pop() {
+  auto guard = reclaimer_.pin();
+  stack_node<T>* node = detach_top();
+  if (!node) {
+    return std::nullopt;
   }
+  std::optional<T> result(std::move(node->data));
+  retire(node);
+  return result;
 }
 
-template <typename T>
-void lockfree_stack<T>::retire(stack_node<T>* retired_ptr) {
-  if (!retired_ptr) {
-    return;
+template <typename T, typename Reclaimer>
+template <typename OutputIt>
+size_t lockfree_stack<T, Reclaimer>::pop_many(size_t n, OutputIt out) {
+  if (n == 0) {
+    return 0;
   }
-  std::thread::id tid = std::this_thread::get_id();
-  retired_[tid].push_back(retired_ptr);
-  if (retired_[tid].size() >= 2 * threads_num_) {
-    scan();
+  auto guard = reclaimer_.pin();
+  while (true) {
+    stack_node<T>* top = reclaimer_.protect(0, top_);
+    if (!top) {
+      return 0;
+    }
+    // Walk down hand over hand, alternating hazard slots 1 and 2 while slot 0
+    // keeps `top` alive for the final CAS. A node never returns to the stack
+    // once popped, so as long as `top` is still on top nothing below it has
+    // changed and the new hazard is valid.
+    stack_node<T>* last = top;
+    size_t count = 1;
+    bool valid = true;
+    for (; count < n; ++count) {
+      stack_node<T>* next = reclaimer_.protect(1 + count % 2, last->next);
+      if (top_.load(std::memory_order_seq_cst) != top) {
+        valid = false;
+        break;
+      }
+      if (!next) {
+        break;
+      }
+      last = next;
+    }
+    if (!valid) {
+      std::this_thread::yield();
+      continue;
+    }
+    stack_node<T>* rest = last->next.load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_weak(top, rest, std::memory_order_acquire,
+                                    std::memory_order_relaxed)) {
+      lockfree_stats::add(stat_counter::stack_pop_cas_failures);
+      std::this_thread::yield();
+      continue;
+    }
+    // The chain is ours now; other threads may still be reading it, so the
+    // nodes go through the reclaimer as usual.
+    stack_node<T>* cur = top;
+    for (size_t i = 0; i < count; ++i) {
+      stack_node<T>* next = cur->next.load(std::memory_order_relaxed);
+      *out = std::move(cur->data);
+      ++out;
+      retire(cur);
+      cur = next;
+    }
+    return count;
   }
 }
 
-template <typename T>
-void lockfree_stack<T>::scan() {
-  std::vector<stack_node<T>*> all_hazard;
-  std::vector<stack_node<T>*> updated_retired;
-  std::thread::id tid = std::this_thread::get_id();
-  for (auto it = hazard_ptrs_.begin(); it != hazard_ptrs_.end(); ++it) {
-    all_hazard.push_back(it->second);
+// 0: A -> C
+// 1: A -> B -> C
+
+template <typename T, typename Reclaimer>
+lockfree_stack<T, Reclaimer>::lockfree_stack(size_t threads_num)
+    : top_(nullptr),
+      threads_num_(threads_num),
+      reclaimer_(threads_num),
+      popped_(new padded<stack_node<T>*>[threads_num]),
+      elimination_(threads_num) {}
+
+template <typename T, typename Reclaimer>
+lockfree_stack<T, Reclaimer>::~lockfree_stack() {
+  for (size_t i = 0; i < threads_num_; ++i) {
+    delete popped_[i].value;
   }
-  std::sort(all_hazard.begin(), all_hazard.end());
-  auto& all_retired = retired_[tid];
-  for (auto& retired : all_retired) {
-    if (std::binary_search(all_hazard.begin(), all_hazard.end(), retired)) {
-      updated_retired.push_back(retired);
-    } else {
-      // std::ostringstream os;
-      // os << all_retired.size() << " " << tid << " Delete retired " << retired
-      //    << "\n";
-      // std::cout << os.str();
-      delete retired;
-    }
+  stack_node<T>* cur = top_.load(std::memory_order_relaxed);
+  while (cur) {
+    stack_node<T>* next = cur->next.load(std::memory_order_relaxed);
+    delete cur;
+    cur = next;
+  }
+}
+
+template <typename T, typename Reclaimer>
+void lockfree_stack<T, Reclaimer>::retire(stack_node<T>* retired_ptr) {
+  if (!retired_ptr) {
+    return;
   }
-  retired_[tid] = updated_retired;
+  reclaimer_.retire(retired_ptr, [](void* p) {
+    delete static_cast<stack_node<T>*>(p);
+  });
 }
 
 #endif  // LOCKFREE_STACK_H
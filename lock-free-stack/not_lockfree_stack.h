@@ -2,6 +2,8 @@
 #define NOT_LOCKFREE_STACK_H
 
 #include <mutex>
+#include <optional>
+#include <utility>
 
 template <typename T>
 struct nstack_node {
@@ -10,6 +12,7 @@ struct nstack_node {
 
   nstack_node() : data{}, next(nullptr) {}
   explicit nstack_node(const T& value) : data(value), next(nullptr) {}
+  explicit nstack_node(T&& value) : data(std::move(value)), next(nullptr) {}
 };
 
 template <typename T>
@@ -17,32 +20,77 @@ class not_lockfree_stack {
  public:
   not_lockfree_stack(int) : top_(nullptr) {}
   void push(const T& val);
+  void push(T&& val);
+  // Returns 0 when the stack is empty, try_pop() tells that apart.
   T pop();
+  bool try_pop(T& out);
+  std::optional<T> try_pop();
 
  private:
   std::mutex lock_;
   nstack_node<T>* top_;
+  void push_node(nstack_node<T>* new_top);
+  nstack_node<T>* detach_top();
 };
 
 template <typename T>
 void not_lockfree_stack<T>::push(const T& val) {
+  push_node(new nstack_node<T>(val));
+}
+
+template <typename T>
+void not_lockfree_stack<T>::push(T&& val) {
+  push_node(new nstack_node<T>(std::move(val)));
+}
+
+template <typename T>
+void not_lockfree_stack<T>::push_node(nstack_node<T>* new_top) {
   std::lock_guard<std::mutex> guard(lock_);
-  nstack_node<T>* new_top = new nstack_node<T>(val);
   new_top->next = top_;
   top_ = new_top;
 }
 
 template <typename T>
-T not_lockfree_stack<T>::pop() {
+nstack_node<T>* not_lockfree_stack<T>::detach_top() {
   std::lock_guard<std::mutex> guard(lock_);
-  if (!top_) {
+  nstack_node<T>* prev_top = top_;
+  if (prev_top) {
+    top_ = prev_top->next;
+  }
+  return prev_top;
+}
+
+template <typename T>
+T not_lockfree_stack<T>::pop() {
+  nstack_node<T>* prev_top = detach_top();
+  if (!prev_top) {
     return 0;
   }
-  T val = top_->data;
-  nstack_node<T>* prev_top = top_;
-  top_ = top_->next;
+  T val = std::move(prev_top->data);
   delete prev_top;
   return val;
 }
 
+template <typename T>
+bool not_lockfree_stack<T>::try_pop(T& out) {
+  nstack_node<T>* prev_top = detach_top();
+  if (!prev_top) {
+    return false;
+  }
+  out = std::move(prev_top->data);
+  delete prev_top;
+  return true;
+}
+
+template <typename T>
+std::optional<T> not_lockfree_stack<T>::try_pop() {
+  nstack_node<T>* prev_top = detach_top();
+  if (!prev_top) {
+    return std::nullopt;
+  }
+  std::optional<T> result(std::move(prev_top->data));
+  delete prev_top;
+  return result;
+}
+
 #endif  // NOT_LOCKFREE_STACK_H
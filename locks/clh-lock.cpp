@@ -0,0 +1,57 @@
+#include "clh-lock.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+// On unlock a thread gives its own node away to the successor and takes the
+// predecessor's node instead, so nodes migrate between threads and locks.
+// Whoever currently owns a node is responsible for deleting it.
+struct node_pool {
+  std::vector<clh_lock::qnode*> free_nodes;
+
+  ~node_pool() {
+    for (auto* node : free_nodes) {
+      delete node;
+    }
+  }
+  clh_lock::qnode* get() {
+    if (free_nodes.empty()) {
+      return new clh_lock::qnode;
+    }
+    auto* node = free_nodes.back();
+    free_nodes.pop_back();
+    return node;
+  }
+  void put(clh_lock::qnode* node) { free_nodes.push_back(node); }
+};
+
+thread_local node_pool pool;
+
+}  // namespace
+
+clh_lock::clh_lock() : tail(new qnode) {}
+
+clh_lock::~clh_lock() {
+  qnode* last = tail.load(std::memory_order_relaxed);
+  assert(!last->locked.load(std::memory_order_relaxed));
+  delete last;
+}
+
+void clh_lock::lock() {
+  qnode* node = pool.get();
+  node->locked.store(true, std::memory_order_relaxed);
+  qnode* pred = tail.exchange(node, std::memory_order_acq_rel);
+  while (pred->locked.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  holder = node;
+  holder_pred = pred;
+}
+
+void clh_lock::unlock() {
+  qnode* pred = holder_pred;
+  holder->locked.store(false, std::memory_order_release);
+  pool.put(pred);
+}
@@ -0,0 +1,31 @@
+#ifndef MY_CLHLOCK
+#define MY_CLHLOCK
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+#include "../common/cache_line.h"
+
+// Queue lock by Craig, Landin and Hagersten. Every waiter spins on the node of
+// its predecessor, which only that predecessor writes, and adopts that node
+// once the lock is handed over.
+class clh_lock {
+ public:
+  struct alignas(padded_alignment<std::atomic_bool>) qnode {
+    std::atomic_bool locked = {false};
+  };
+
+ private:
+  padded_atomic<qnode*> tail;
+  qnode* holder = nullptr;
+  qnode* holder_pred = nullptr;
+
+ public:
+  clh_lock();
+  ~clh_lock();
+  void lock();
+  void unlock();
+};
+
+#endif  // MY_CLHLOCK
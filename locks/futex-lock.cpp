@@ -0,0 +1,66 @@
+#include "futex-lock.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "../common/backoff.h"
+
+namespace {
+
+static_assert(sizeof(std::atomic_int) == sizeof(int),
+              "futex word must be a plain int");
+
+void futex_wait(std::atomic_int* addr, int expected) {
+  syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE,
+          expected, nullptr, nullptr, 0);
+}
+
+void futex_wake_one(std::atomic_int* addr) {
+  syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE, 1,
+          nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+futex_lock::~futex_lock() {
+  assert(state.load(std::memory_order_relaxed) == 0);
+}
+
+void futex_lock::lock() {
+  int c = 0;
+  if (state.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                    std::memory_order_relaxed)) {
+    return;
+  }
+  const int estimate = spin_estimate.load(std::memory_order_relaxed);
+  const int budget = std::min(max_spins, std::max(min_spins, 2 * estimate));
+  for (int spins = 0; spins < budget; ++spins) {
+    c = 0;
+    if (state.load(std::memory_order_relaxed) == 0 &&
+        state.compare_exchange_weak(c, 1, std::memory_order_acquire,
+                                    std::memory_order_relaxed)) {
+      spin_estimate.store(estimate + (spins - estimate) / 8,
+                          std::memory_order_relaxed);
+      return;
+    }
+    cpu_relax();
+  }
+  spin_estimate.store(estimate + (budget - estimate) / 8,
+                      std::memory_order_relaxed);
+  // From now on the lock is held in state 2, so the holder knows it has to
+  // wake somebody up.
+  c = state.exchange(2, std::memory_order_acquire);
+  while (c != 0) {
+    futex_wait(&state, 2);
+    c = state.exchange(2, std::memory_order_acquire);
+  }
+}
+
+void futex_lock::unlock() {
+  if (state.exchange(0, std::memory_order_release) == 2) {
+    futex_wake_one(&state);
+  }
+}
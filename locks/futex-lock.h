@@ -0,0 +1,26 @@
+#ifndef MY_FUTEXLOCK
+#define MY_FUTEXLOCK
+
+#include <atomic>
+#include <cassert>
+
+#include "../common/cache_line.h"
+
+// Adaptive lock: spins for a bounded number of iterations, then parks the
+// thread on a Linux futex. The spin budget follows a running average of how
+// long recent acquisitions actually had to spin.
+class futex_lock {
+  // 0 - unlocked, 1 - locked, 2 - locked and someone may be parked.
+  padded_atomic<int> state = {0};
+  std::atomic_int spin_estimate = {0};
+
+  static constexpr int min_spins = 16;
+  static constexpr int max_spins = 4096;
+
+ public:
+  ~futex_lock();
+  void lock();
+  void unlock();
+};
+
+#endif  // MY_FUTEXLOCK
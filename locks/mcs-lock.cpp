@@ -0,0 +1,70 @@
+#include "mcs-lock.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Queue nodes are owned by threads, not by locks: a node is free again as soon
+// as its owner has handed the lock over, so a thread only needs as many nodes
+// as the number of mcs_locks it holds at once.
+struct node_pool {
+  std::vector<mcs_lock::qnode*> free_nodes;
+
+  ~node_pool() {
+    for (auto* node : free_nodes) {
+      delete node;
+    }
+  }
+  mcs_lock::qnode* get() {
+    if (free_nodes.empty()) {
+      return new mcs_lock::qnode;
+    }
+    auto* node = free_nodes.back();
+    free_nodes.pop_back();
+    return node;
+  }
+  void put(mcs_lock::qnode* node) { free_nodes.push_back(node); }
+};
+
+thread_local node_pool pool;
+
+}  // namespace
+
+mcs_lock::~mcs_lock() {
+  assert(tail.load(std::memory_order_relaxed) == nullptr);
+}
+
+void mcs_lock::lock() {
+  qnode* node = pool.get();
+  node->next.store(nullptr, std::memory_order_relaxed);
+  node->locked.store(true, std::memory_order_relaxed);
+  qnode* pred = tail.exchange(node, std::memory_order_acq_rel);
+  if (pred) {
+    pred->next.store(node, std::memory_order_release);
+    while (node->locked.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  holder = node;
+}
+
+void mcs_lock::unlock() {
+  qnode* node = holder;
+  qnode* succ = node->next.load(std::memory_order_acquire);
+  if (!succ) {
+    qnode* expected = node;
+    if (tail.compare_exchange_strong(expected, nullptr,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+      pool.put(node);
+      return;
+    }
+    // A successor swapped itself into the tail but has not linked yet.
+    while (!(succ = node->next.load(std::memory_order_acquire))) {
+      std::this_thread::yield();
+    }
+  }
+  succ->locked.store(false, std::memory_order_release);
+  pool.put(node);
+}
@@ -0,0 +1,29 @@
+#ifndef MY_MCSLOCK
+#define MY_MCSLOCK
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+#include "../common/cache_line.h"
+
+// Queue lock by Mellor-Crummey and Scott. Every waiter spins on the `locked`
+// flag of its own node, so a handoff touches only the successor's cache line.
+class mcs_lock {
+ public:
+  struct alignas(padded_alignment<std::atomic<void*>>) qnode {
+    std::atomic<qnode*> next = {nullptr};
+    std::atomic_bool locked = {false};
+  };
+
+ private:
+  padded_atomic<qnode*> tail = {nullptr};
+  qnode* holder = nullptr;
+
+ public:
+  ~mcs_lock();
+  void lock();
+  void unlock();
+};
+
+#endif  // MY_MCSLOCK
@@ -0,0 +1,162 @@
+#include "rw-lock.h"
+
+#include <sched.h>
+
+#include <thread>
+
+template <bool prefer_writers>
+rw_spin_lock<prefer_writers>::~rw_spin_lock() {
+  assert(state.load(std::memory_order_relaxed) == 0);
+}
+
+template <bool prefer_writers>
+void rw_spin_lock<prefer_writers>::lock() {
+  while (true) {
+    uint32_t s = state.load(std::memory_order_relaxed);
+    if ((s & ~writer_waiting) == 0) {
+      // Taking the lock also clears `writer_waiting`, the other waiting
+      // writers set it again on their next round.
+      if (state.compare_exchange_weak(s, writer, std::memory_order_acquire,
+                                      std::memory_order_relaxed)) {
+        return;
+      }
+      continue;
+    }
+    if (prefer_writers && !(s & writer_waiting)) {
+      state.fetch_or(writer_waiting, std::memory_order_relaxed);
+    }
+    std::this_thread::yield();
+  }
+}
+
+template <bool prefer_writers>
+void rw_spin_lock<prefer_writers>::unlock() {
+  state.fetch_and(~writer, std::memory_order_release);
+}
+
+template <bool prefer_writers>
+void rw_spin_lock<prefer_writers>::lock_shared() {
+  constexpr uint32_t blocking =
+      prefer_writers ? (writer | writer_waiting) : writer;
+  while (true) {
+    uint32_t s = state.load(std::memory_order_relaxed);
+    if (s & blocking) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (state.compare_exchange_weak(s, s + reader, std::memory_order_acquire,
+                                    std::memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+template <bool prefer_writers>
+void rw_spin_lock<prefer_writers>::unlock_shared() {
+  state.fetch_sub(reader, std::memory_order_release);
+}
+
+namespace {
+
+size_t reader_slot() {
+  // Pinned on first use to the core the thread started on. Unlock must hit
+  // the same counter as lock, so the slot does not follow later migrations.
+  static std::atomic_size_t next_slot = {0};
+  thread_local const size_t slot = [] {
+    int cpu = sched_getcpu();
+    return cpu >= 0 ? static_cast<size_t>(cpu)
+                    : next_slot.fetch_add(1, std::memory_order_relaxed);
+  }();
+  return slot;
+}
+
+}  // namespace
+
+template <bool prefer_writers>
+distributed_rw_lock<prefer_writers>::~distributed_rw_lock() {
+  assert(!writer.load(std::memory_order_relaxed) && no_readers());
+}
+
+template <bool prefer_writers>
+bool distributed_rw_lock<prefer_writers>::no_readers() const {
+  for (const auto& counter : readers) {
+    if (counter.load(std::memory_order_seq_cst) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <bool prefer_writers>
+bool distributed_rw_lock<prefer_writers>::try_lock_writer() {
+  bool expected = false;
+  return !writer.load(std::memory_order_relaxed) &&
+         writer.compare_exchange_strong(expected, true,
+                                        std::memory_order_seq_cst);
+}
+
+template <bool prefer_writers>
+void distributed_rw_lock<prefer_writers>::lock() {
+  if (prefer_writers) {
+    waiting_writers.fetch_add(1, std::memory_order_relaxed);
+    while (!try_lock_writer()) {
+      std::this_thread::yield();
+    }
+    // New readers back off once they see `writer`, wait for the old ones.
+    while (!no_readers()) {
+      std::this_thread::yield();
+    }
+    waiting_writers.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  while (true) {
+    while (!no_readers()) {
+      std::this_thread::yield();
+    }
+    if (try_lock_writer()) {
+      if (no_readers()) {
+        return;
+      }
+      // A reader slipped in between the scan and the flag, let it go first.
+      writer.store(false, std::memory_order_release);
+    }
+    std::this_thread::yield();
+  }
+}
+
+template <bool prefer_writers>
+void distributed_rw_lock<prefer_writers>::unlock() {
+  writer.store(false, std::memory_order_release);
+}
+
+template <bool prefer_writers>
+void distributed_rw_lock<prefer_writers>::lock_shared() {
+  auto& counter = readers[reader_slot() % slots_num];
+  while (true) {
+    if (prefer_writers) {
+      while (waiting_writers.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+      }
+    }
+    // Publish the reader first, then look for a writer. The writer does the
+    // same in the opposite order, so at least one of them sees the other.
+    counter.fetch_add(1, std::memory_order_seq_cst);
+    if (!writer.load(std::memory_order_seq_cst)) {
+      return;
+    }
+    counter.fetch_sub(1, std::memory_order_release);
+    while (writer.load(std::memory_order_relaxed)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <bool prefer_writers>
+void distributed_rw_lock<prefer_writers>::unlock_shared() {
+  readers[reader_slot() % slots_num].fetch_sub(1, std::memory_order_release);
+}
+
+template class rw_spin_lock<true>;
+template class rw_spin_lock<false>;
+template class distributed_rw_lock<true>;
+template class distributed_rw_lock<false>;
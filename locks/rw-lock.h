@@ -0,0 +1,56 @@
+#ifndef MY_RWLOCK
+#define MY_RWLOCK
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "../common/cache_line.h"
+
+// Both locks follow the std::shared_mutex naming: lock()/unlock() for writers,
+// lock_shared()/unlock_shared() for readers. With `prefer_writers` a waiting
+// writer stops new readers from coming in, otherwise a writer only gets in
+// once no reader holds the lock.
+
+// Centralized reader-writer spin lock: a single word with the writer bit, the
+// "writer waiting" bit and the reader count.
+template <bool prefer_writers = true>
+class rw_spin_lock {
+  static constexpr uint32_t writer = 1;
+  static constexpr uint32_t writer_waiting = 2;
+  static constexpr uint32_t reader = 4;
+
+  padded_atomic<uint32_t> state = {0};
+
+ public:
+  ~rw_spin_lock();
+  void lock();
+  void unlock();
+  void lock_shared();
+  void unlock_shared();
+};
+
+// Reader-writer lock with per-core reader indicators. A reader only touches
+// the counter of the slot it is running on, so readers on different cores
+// never write the same cache line; writers pay for this by scanning all slots.
+template <bool prefer_writers = true>
+class distributed_rw_lock {
+  static constexpr size_t slots_num = 64;
+
+  padded_atomic<size_t> readers[slots_num] = {};
+  padded_atomic<bool> writer = {false};
+  padded_atomic<size_t> waiting_writers = {0};
+
+  bool no_readers() const;
+  bool try_lock_writer();
+
+ public:
+  ~distributed_rw_lock();
+  void lock();
+  void unlock();
+  void lock_shared();
+  void unlock_shared();
+};
+
+#endif  // MY_RWLOCK
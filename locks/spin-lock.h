@@ -4,8 +4,10 @@
 #include <atomic>
 #include <cassert>
 
+#include "../common/cache_line.h"
+
 class spin_lock_TTAS {
-  std::atomic<unsigned int> m_spin;
+  padded_atomic<unsigned int> m_spin;
 
  public:
   spin_lock_TTAS();
@@ -1,15 +1,15 @@
+import csv
+import statistics
 import sys
 
 
-even = True
-mean_val = 0
-max_val = 0
-for line in sys.stdin:
-    val = int(line)
-    if even:
-        max_val += val
-    else:
-        mean_val += val
-    even = not even
-print(str(max_val / 10) + ' ' + str(mean_val / 10))
-
+# Reads the CSV of several runs of the same benchmark and prints the median
+# of the throughput and of every latency percentile across the runs.
+runs = [row for row in csv.DictReader(sys.stdin)
+        if row['structure'] != 'structure']
+for column in runs[0]:
+    if column != 'ops_per_sec' and '_p' not in column:
+        continue
+    values = [float(row[column]) for row in runs if row[column]]
+    if values:
+        print(column + ' ' + str(statistics.median(values)))
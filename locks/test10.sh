@@ -1,6 +1,8 @@
 #!/bin/bash
+# Usage: locks/test10.sh <lock> <threads> [bench options] | python3 locks/summator.py
+# Run from the repository root after building bench/bench.cpp into ./a.out.
 
 for i in {1..10}
 do
-    ./ticket-lock $1
+    ./a.out $1 --threads=$2 --format=csv "${@:3}"
 done
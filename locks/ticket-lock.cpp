@@ -1,5 +1,6 @@
 #include "ticket-lock.h"
 
+#include <chrono>
 #include <thread>
 
 void ticket_lock::lock() {
@@ -13,3 +14,55 @@ void ticket_lock::unlock() {
   const auto successor = now_serving.load(std::memory_order_relaxed) + 1;
   now_serving.store(successor, std::memory_order_release);
 }
+
+namespace {
+
+// Below this a sleep_for() overshoots by more than it waits.
+constexpr int64_t min_sleep_ns = 100000;
+
+int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+void proportional_ticket_lock::lock() {
+  const auto ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+  while (true) {
+    const auto serving = now_serving.load(std::memory_order_acquire);
+    if (serving == ticket) {
+      break;
+    }
+    const auto distance = ticket - serving;
+    const int64_t estimate = hold_estimate_ns.load(std::memory_order_relaxed);
+    if (distance == 1 || estimate == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    // Undershoot a bit: arriving early costs a few extra polls, arriving late
+    // leaves the lock idle.
+    const int64_t wait_ns = (distance - 1) * estimate * 3 / 4;
+    if (wait_ns >= min_sleep_ns) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+      continue;
+    }
+    // Too short to be worth a timer: yield until the deadline, reading only
+    // the clock and not the shared counter.
+    const int64_t deadline = now_ns() + wait_ns;
+    do {
+      std::this_thread::yield();
+    } while (now_ns() < deadline);
+  }
+  acquired_at_ns = now_ns();
+}
+
+void proportional_ticket_lock::unlock() {
+  const int64_t held = now_ns() - acquired_at_ns;
+  const int64_t estimate = hold_estimate_ns.load(std::memory_order_relaxed);
+  hold_estimate_ns.store(estimate + (held - estimate) / 8,
+                         std::memory_order_relaxed);
+  const auto successor = now_serving.load(std::memory_order_relaxed) + 1;
+  now_serving.store(successor, std::memory_order_release);
+}
@@ -2,10 +2,30 @@
 #define MY_TICKETLOCK
 
 #include <atomic>
+#include <cstdint>
 
+#include "../common/cache_line.h"
+
+// Arrivals bump `next_ticket` while waiters poll `now_serving`, so the two live
+// on separate cache lines.
 class ticket_lock {
-  std::atomic_size_t now_serving = {0};
-  std::atomic_size_t next_ticket = {0};
+  padded_atomic<size_t> now_serving = {0};
+  padded_atomic<size_t> next_ticket = {0};
+
+ public:
+  void lock();
+  void unlock();
+};
+
+// Ticket lock with proportional backoff: a waiter that is `d` tickets behind
+// stays away from `now_serving` for about `d - 1` critical sections, so only
+// the next in line keeps polling it. The critical-section length is a running
+// average measured by the lock holders themselves.
+class proportional_ticket_lock {
+  padded_atomic<size_t> now_serving = {0};
+  padded_atomic<size_t> next_ticket = {0};
+  std::atomic<int64_t> hold_estimate_ns = {0};
+  int64_t acquired_at_ns = 0;
 
  public:
   void lock();
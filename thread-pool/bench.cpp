@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "thread_pool.h"
+
+// Recursive fork/join Fibonacci: every call above the cutoff spawns its first
+// half as a task and computes the second half itself.
+#define CUTOFF 20
+
+int64_t serial_fib(int n) {
+  return n < 2 ? n : serial_fib(n - 1) + serial_fib(n - 2);
+}
+
+int64_t fib(thread_pool& pool, int n) {
+  if (n < CUTOFF) {
+    return serial_fib(n);
+  }
+  int64_t left = 0;
+  task_group group(pool);
+  group.run([&pool, &left, n] { left = fib(pool, n - 1); });
+  int64_t right = fib(pool, n - 2);
+  group.wait();
+  return left + right;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: ./%s <num_of_threads> <n>\n", argv[0]);
+    return 1;
+  }
+  int n_threads = atoi(argv[1]);
+  int n = atoi(argv[2]);
+
+  auto start = std::chrono::steady_clock::now();
+  int64_t expected = serial_fib(n);
+  auto finish = std::chrono::steady_clock::now();
+  int64_t serial_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start)
+          .count();
+
+  thread_pool pool(n_threads);
+  start = std::chrono::steady_clock::now();
+  int64_t result = 0;
+  {
+    task_group group(pool);
+    group.run([&pool, &result, n] { result = fib(pool, n); });
+  }
+  finish = std::chrono::steady_clock::now();
+  int64_t parallel_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start)
+          .count();
+  if (result != expected) {
+    std::cerr << "Wrong result: " << result << " instead of " << expected
+              << std::endl;
+    return 1;
+  }
+  // Parallel time in nanoseconds and speedup over the serial run.
+  std::cout << parallel_ns << ' '
+            << static_cast<double>(serial_ns) / parallel_ns << '\n';
+  return 0;
+}
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+g++ -O2 -pthread bench.cpp thread_pool.cpp
+for i in 1 2 4 8 16 32 64
+do
+    ./a.out $i 36
+done
@@ -0,0 +1,148 @@
+#include "thread_pool.h"
+
+namespace {
+
+// Pool and deque index of the current thread, if it is a worker.
+thread_local const void* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+// Failed rounds of stealing before a worker parks.
+constexpr int spins_before_parking = 64;
+
+uint64_t next_random(uint64_t& seed) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+}  // namespace
+
+thread_pool::thread_pool(size_t threads_num) {
+  if (threads_num == 0) {
+    threads_num = 1;
+  }
+  for (size_t i = 0; i < threads_num; ++i) {
+    workers_.emplace_back(new worker);
+    workers_.back()->seed = 0x9E3779B97F4A7C15ull * (i + 1);
+  }
+  threads_.reserve(threads_num);
+  for (size_t i = 0; i < threads_num; ++i) {
+    threads_.emplace_back(&thread_pool::worker_loop, this, i);
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> guard(park_lock_);
+    stopping_.store(true, std::memory_order_release);
+  }
+  park_cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+  for (auto* t : injection_) {
+    delete t;
+  }
+  for (auto& w : workers_) {
+    task* t;
+    while (w->tasks.pop(t)) {
+      delete t;
+    }
+  }
+}
+
+void thread_pool::submit(std::function<void()> fn) {
+  auto* t = new task(std::move(fn));
+  if (current_pool == this) {
+    workers_[current_index]->tasks.push(t);
+  } else {
+    std::lock_guard<std::mutex> guard(injection_lock_);
+    injection_.push_back(t);
+    injected_.fetch_add(1, std::memory_order_release);
+  }
+  notify();
+}
+
+void thread_pool::notify() {
+  // Pairs with the check in worker_loop: either the worker sees the new
+  // epoch before going to sleep, or we see it sleeping and wake it up.
+  work_epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_seq_cst) != 0) {
+    std::lock_guard<std::mutex> guard(park_lock_);
+    park_cv_.notify_one();
+  }
+}
+
+thread_pool::task* thread_pool::find_task() {
+  task* t = nullptr;
+  const bool is_worker = current_pool == this;
+  if (is_worker && workers_[current_index]->tasks.pop(t)) {
+    return t;
+  }
+  if (injected_.load(std::memory_order_acquire) != 0) {
+    std::lock_guard<std::mutex> guard(injection_lock_);
+    if (!injection_.empty()) {
+      t = injection_.front();
+      injection_.pop_front();
+      injected_.fetch_sub(1, std::memory_order_relaxed);
+      return t;
+    }
+  }
+  thread_local uint64_t seed = reinterpret_cast<uintptr_t>(&seed) | 1;
+  uint64_t& rnd = is_worker ? workers_[current_index]->seed : seed;
+  const size_t n = workers_.size();
+  const size_t start = next_random(rnd) % n;
+  for (size_t i = 0; i < n; ++i) {
+    size_t victim = (start + i) % n;
+    if (is_worker && victim == current_index) {
+      continue;
+    }
+    if (workers_[victim]->tasks.steal(t)) {
+      return t;
+    }
+  }
+  return nullptr;
+}
+
+bool thread_pool::run_one() {
+  task* t = find_task();
+  if (!t) {
+    return false;
+  }
+  (*t)();
+  delete t;
+  return true;
+}
+
+void thread_pool::worker_loop(size_t index) {
+  current_pool = this;
+  current_index = index;
+  int idle_rounds = 0;
+  while (!stopping_.load(std::memory_order_acquire)) {
+    if (run_one()) {
+      idle_rounds = 0;
+      continue;
+    }
+    if (++idle_rounds < spins_before_parking) {
+      std::this_thread::yield();
+      continue;
+    }
+    sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    const uint64_t epoch = work_epoch_.load(std::memory_order_seq_cst);
+    if (run_one()) {
+      sleeping_.fetch_sub(1, std::memory_order_relaxed);
+      idle_rounds = 0;
+      continue;
+    }
+    {
+      std::unique_lock<std::mutex> lock(park_lock_);
+      park_cv_.wait(lock, [&] {
+        return stopping_.load(std::memory_order_relaxed) ||
+               work_epoch_.load(std::memory_order_relaxed) != epoch;
+      });
+    }
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    idle_rounds = 0;
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../common/cache_line.h"
+#include "work_stealing_deque.h"
+
+// Fixed-size pool of workers, each with its own work-stealing deque. Tasks
+// submitted from a worker go to the bottom of its own deque, so recursive
+// fork/join work stays local; tasks submitted from outside go through a shared
+// injection queue. A worker that runs out of work steals from the top of a
+// random victim, and after a while without finding anything parks on a
+// condition variable until new work is submitted.
+class thread_pool {
+ public:
+  explicit thread_pool(size_t threads_num = std::thread::hardware_concurrency());
+  ~thread_pool();
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  void submit(std::function<void()> fn);
+  // Runs one pending task on the calling thread, if there is any.
+  bool run_one();
+  // Helps with pending tasks until `done()` holds, so a task may wait for its
+  // children without blocking a worker.
+  template <typename Pred>
+  void wait_until(Pred done) {
+    while (!done()) {
+      if (!run_one()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+  size_t size() const { return workers_.size(); }
+
+ private:
+  using task = std::function<void()>;
+
+  struct alignas(cache_line_size) worker {
+    work_stealing_deque<task*> tasks;
+    uint64_t seed;
+  };
+
+  void worker_loop(size_t index);
+  task* find_task();
+  void notify();
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::mutex injection_lock_;
+  std::deque<task*> injection_;
+  padded_atomic<size_t> injected_ = {0};
+
+  std::mutex park_lock_;
+  std::condition_variable park_cv_;
+  padded_atomic<size_t> sleeping_ = {0};
+  padded_atomic<uint64_t> work_epoch_ = {0};
+  std::atomic_bool stopping_ = {false};
+};
+
+// Counts outstanding tasks of a fork/join region.
+class task_group {
+ public:
+  explicit task_group(thread_pool& pool) : pool_(pool) {}
+  ~task_group() { wait(); }
+
+  template <typename F>
+  void run(F&& fn) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    pool_.submit([this, fn = std::forward<F>(fn)]() mutable {
+      fn();
+      pending_.fetch_sub(1, std::memory_order_release);
+    });
+  }
+  void wait() {
+    pool_.wait_until(
+        [this] { return pending_.load(std::memory_order_acquire) == 0; });
+  }
+
+ private:
+  thread_pool& pool_;
+  std::atomic_size_t pending_ = {0};
+};
+
+#endif  // THREAD_POOL_H
@@ -0,0 +1,135 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "../common/cache_line.h"
+
+// Chase-Lev work-stealing deque, with the memory orderings of Le, Pop, Cohen
+// and Zappa Nardelli. The owner pushes and pops at the bottom without
+// contention; thieves take from the top and only race with the owner for the
+// last element. The buffer grows when full; old buffers are kept until the
+// deque is destroyed because a thief may still be reading one.
+template <typename T>
+class work_stealing_deque {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "elements are stored in atomics");
+
+ public:
+  explicit work_stealing_deque(size_t capacity = 64)
+      : buffer_(new ring(round_up(capacity))) {
+    buffers_.emplace_back(buffer_.load(std::memory_order_relaxed));
+  }
+
+  // Owner only.
+  void push(T item);
+  // Owner only. False if the deque is empty.
+  bool pop(T& out);
+  // Any thread. False if the deque is empty or another thread won the race.
+  bool steal(T& out);
+
+  bool empty() const {
+    return top_.load(std::memory_order_relaxed) >=
+           bottom_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct ring {
+    explicit ring(size_t size)
+        : mask(size - 1), items(new std::atomic<T>[size]) {}
+    T get(int64_t i) const {
+      return items[i & mask].load(std::memory_order_relaxed);
+    }
+    void put(int64_t i, T item) {
+      items[i & mask].store(item, std::memory_order_relaxed);
+    }
+    size_t size() const { return mask + 1; }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<T>[]> items;
+  };
+
+  static size_t round_up(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    return size;
+  }
+  ring* grow(ring* old, int64_t top, int64_t bottom);
+
+  padded_atomic<int64_t> top_ = {0};
+  padded_atomic<int64_t> bottom_ = {0};
+  padded_atomic<ring*> buffer_;
+  // Owner only.
+  std::vector<std::unique_ptr<ring>> buffers_;
+};
+
+template <typename T>
+typename work_stealing_deque<T>::ring* work_stealing_deque<T>::grow(
+    ring* old, int64_t top, int64_t bottom) {
+  auto* bigger = new ring(old->size() * 2);
+  for (int64_t i = top; i < bottom; ++i) {
+    bigger->put(i, old->get(i));
+  }
+  buffers_.emplace_back(bigger);
+  buffer_.store(bigger, std::memory_order_release);
+  return bigger;
+}
+
+template <typename T>
+void work_stealing_deque<T>::push(T item) {
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_acquire);
+  ring* a = buffer_.load(std::memory_order_relaxed);
+  if (b - t > static_cast<int64_t>(a->size()) - 1) {
+    a = grow(a, t, b);
+  }
+  a->put(b, item);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool work_stealing_deque<T>::pop(T& out) {
+  int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  ring* a = buffer_.load(std::memory_order_relaxed);
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+  if (t > b) {
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+  out = a->get(b);
+  if (t == b) {
+    // Last element: race the thieves for it.
+    bool won = top_.compare_exchange_strong(t, t + 1,
+                                            std::memory_order_seq_cst,
+                                            std::memory_order_relaxed);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return won;
+  }
+  return true;
+}
+
+template <typename T>
+bool work_stealing_deque<T>::steal(T& out) {
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom_.load(std::memory_order_acquire);
+  if (t >= b) {
+    return false;
+  }
+  ring* a = buffer_.load(std::memory_order_acquire);
+  out = a->get(t);
+  return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed);
+}
+
+#endif  // WORK_STEALING_DEQUE_H